@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+# `sia foo.sia` against the executable `sia build foo.sia` makes of it: startup, the wall time of a
+# one-line script averaged over STARTS runs, then steady state, the CPU time of longer programs.
+# run from the repository root, SIA=path/to/sia RUNS=5 STARTS=200 bench/build.sh
+set -e
+cd "$(dirname "$0")/.."
+. bench/common.sh
+STARTS=${STARTS:-200}
+
+# the generated code is compiled with the runtime sources of this tree
+export SIA_RUNTIME_DIR=${SIA_RUNTIME_DIR:-$PWD/src}
+built=$(mktemp -d)
+trap 'rm -rf "$built"' EXIT
+
+# average_wall <command...>: the mean wall seconds of STARTS runs
+average_wall() {
+    local start end
+    start=$(date +%s%N)
+    for _ in $(seq "$STARTS"); do "$@" > /dev/null; done
+    end=$(date +%s%N)
+    awk -v ns=$((end - start)) -v runs="$STARTS" 'BEGIN { printf "%.2f ms", ns / runs / 1e6 }'
+}
+
+for program in hello loop fib calls append; do
+    "$SIA" build "bench/$program.sia" -o "$built/$program"
+done
+
+echo "startup (wall, mean of $STARTS)    sia            built"
+printf "  %-30s %-14s %s\n" hello "$(average_wall "$SIA" bench/hello.sia)" "$(average_wall "$built/hello")"
+echo "steady state (CPU, min of $RUNS)"
+for program in loop fib calls append; do
+    printf "  %-30s %-14s %s\n" "$program" "$(min_cpu "$SIA" "bench/$program.sia") s" "$(min_cpu "$built/$program") s"
+done
@@ -0,0 +1,27 @@
+# shared by the benchmark scripts, sourced rather than run
+
+# the interpreter under test, build it first
+SIA=${SIA:-build/sia}
+RUNS=${RUNS:-5}
+
+if [ ! -x "$SIA" ]; then
+    echo "No interpreter at $SIA, build it or set SIA" >&2
+    exit 1
+fi
+
+# min_cpu <command...>: the least user + system seconds of RUNS runs, output discarded. sia exits 0
+# on a runtime error, so a script that prints one isn't timed: min_cpu prints error and fails
+min_cpu() {
+    local best="" seconds errors
+    errors=$("$@" 2>&1 > /dev/null)
+    if [ -n "$errors" ]; then
+        echo "$*:$errors" >&2
+        echo error
+        return 1
+    fi
+    for _ in $(seq "$RUNS"); do
+        seconds=$( { TIMEFORMAT='%U %S'; time "$@" > /dev/null 2>&1; } 2>&1 | awk '{ printf "%.3f", $1 + $2 }')
+        if [ -z "$best" ] || awk -v a="$seconds" -v b="$best" 'BEGIN { exit !(a < b) }'; then best=$seconds; fi
+    done
+    echo "$best"
+}
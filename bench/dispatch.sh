@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+# cost of dispatching on one expression node in the tree walker: wide.sia evaluates 63 nodes per
+# iteration where narrow.sia evaluates one, over 200k iterations. run from the repository root,
+# SIA=path/to/sia RUNS=5 bench/dispatch.sh
+set -e
+cd "$(dirname "$0")/.."
+. bench/common.sh
+
+# no options, so that any version of sia runs it
+wide=$(min_cpu "$SIA" bench/dispatch/wide.sia)
+narrow=$(min_cpu "$SIA" bench/dispatch/narrow.sia)
+awk -v wide="$wide" -v narrow="$narrow" 'BEGIN {
+    nodes = 200000 * 62
+    printf "wide    %s s\nnarrow  %s s\n", wide, narrow
+    printf "%.1fM nodes, %.1f ns/node\n", nodes / 1e6, (wide - narrow) * 1e9 / nodes
+}'
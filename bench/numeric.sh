@@ -0,0 +1,15 @@
+#!/usr/bin/env bash
+# long arithmetic in every engine: CPU time of the numeric programs, the tree walker with and
+# without --jit, --vm and --closures. run from the repository root, SIA=path/to/sia RUNS=5 bench/numeric.sh
+set -e
+cd "$(dirname "$0")/.."
+. bench/common.sh
+
+printf "%-10s %-10s %-10s %-10s %s\n" "" walker --jit --vm --closures
+for program in loop fib ten mulmod; do
+    printf "%-10s" "$program"
+    for engine in "" --jit --vm --closures; do
+        printf " %-10s" "$(min_cpu "$SIA" $engine "bench/$program.sia" 2> /dev/null)"
+    done
+    echo
+done
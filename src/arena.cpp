@@ -0,0 +1,35 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "arena.hpp"
+
+using namespace std;
+
+// blocks start small for the REPL and double up to this size for large programs
+static const size_t first_block_size = 4096;
+static const size_t max_block_size = 1 << 20;
+
+Arena::Arena() : current_(nullptr), end_(nullptr), next_block_size_(first_block_size), bytes_used_(0) {}
+
+Arena::~Arena() {
+    for (char* block : blocks_) free(block);
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+    uintptr_t address = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+    if (!current_ || address + size > reinterpret_cast<uintptr_t>(end_)) {
+        size_t block_size = max(next_block_size_, size + alignment);
+        char* block = static_cast<char*>(malloc(block_size));
+        if (!block) throw bad_alloc();
+        blocks_.push_back(block);
+        current_ = block;
+        end_ = block + block_size;
+        next_block_size_ = min(next_block_size_ * 2, max_block_size);
+        address = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+    }
+    current_ = reinterpret_cast<char*>(address + size);
+    bytes_used_ += size;
+    return reinterpret_cast<void*>(address);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// fixed-size array allocated in an arena, used for the child lists of AST nodes
+template <typename T>
+class ArenaList {
+public:
+    ArenaList() : items_(nullptr), size_(0) {}
+    ArenaList(T* items, size_t size) : items_(items), size_(size) {}
+
+    T* begin() const { return items_; }
+    T* end() const { return items_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](size_t index) const { return items_[index]; }
+
+private:
+    T* items_;
+    size_t size_;
+};
+
+// bump allocator, everything it hands out is released at once when the arena is destroyed.
+// destructors are never run, so only objects that don't own resources can live in it
+class Arena {
+public:
+    Arena();
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    virtual ~Arena();
+
+    void* allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // copies items[from, end) into the arena
+    template <typename T, typename U>
+    ArenaList<T> make_list(const vector<U>& items, size_t from = 0) {
+        const size_t size = items.size() - from;
+        if (size == 0) return ArenaList<T>();
+        T* list = static_cast<T*>(allocate(sizeof(T) * size, alignof(T)));
+        for (size_t i = 0; i < size; i++) new (list + i) T(static_cast<T>(items[from + i]));
+        return ArenaList<T>(list, size);
+    }
+
+    size_t bytes_used() const { return bytes_used_; }
+
+private:
+    vector<char*> blocks_;
+    char* current_;
+    char* end_;
+    size_t next_block_size_;
+    size_t bytes_used_;
+};
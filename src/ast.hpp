@@ -1,228 +1,284 @@
 #pragma once
 
+#include "arena.hpp"
+#include "symbols.hpp"
 #include "token.hpp"
-#include <memory>
-#include <string>
-#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
 
 using namespace std;
 
+// nodes live in the arena of their ProgramNode and are never deleted one by one.
+// identifiers and string literals are symbols of the program, whose text points into the source,
+// so the source has to outlive the tree
+
+// set by every node's constructor, the evaluator dispatches on it instead of using RTTI
+enum class NodeKind : unsigned char {
+    Program, Block, Assignment, BinaryOp, UnaryOp, Variable,
+    StringLiteral, LongNumberLiteral, DoubleNumberLiteral, BoolLiteral,
+    FunctionDef, FunctionCall, ExpressionStatement, Return, Loop, IfElse,
+};
+
+// slot of a variable the resolver couldn't bind, it is then looked up by name at run time
+constexpr uint32_t no_slot = UINT32_MAX;
+
+// the variables a scope can hold: a function body with its parameters, a bare block or the program.
+// names are sorted so they can be binary searched, a variable's slot is its index
+struct ScopeLayout {
+    ArenaList<Symbol> names;
+    // slots of a function's parameters, in declaration order
+    ArenaList<uint32_t> parameters;
+
+    uint32_t find(Symbol name) const {
+        auto it = lower_bound(names.begin(), names.end(), name);
+        return it != names.end() && *it == name ? uint32_t(it - names.begin()) : no_slot;
+    }
+};
+
+// nodes have no vtable, the arena never runs their destructors anyway
 class ASTNode {
 public:
-    unsigned int line, column;
-    virtual ~ASTNode() = default;
+    NodeKind kind;
+    // index into the program's line table
+    uint32_t position;
 };
 
 class StatementNode : public ASTNode {};
 class ExpressionNode : public ASTNode {};
+class FunctionDefNode;
 
 class ProgramNode : public ASTNode {
 public:
-    vector<unique_ptr<StatementNode>> statements;
-
-    virtual ~ProgramNode() = default;
+    Arena arena;
+    ArenaList<StatementNode*> statements;
+    // side tables of every node, they keep growing when function bodies are parsed lazily
+    mutable SymbolTable symbols;
+    mutable LineTable lines;
+    // scope of the top-level statements, set by the resolver
+    const ScopeLayout* layout = nullptr;
+    // set by the optimizer, bodies parsed on their first call are then optimized as well
+    bool optimized = false;
+    // functions whose calls the optimizer replaces with their body, by name, and the calls it
+    // replaced so far, in bodies parsed on their first call too
+    unordered_map<Symbol, const FunctionDefNode*> inlinable;
+    mutable size_t inlined_calls = 0;
+
+    ProgramNode() {
+        this->kind = NodeKind::Program;
+        this->position = 0;
+    }
 };
 
 class BlockNode : public StatementNode {
 public:
-    vector<unique_ptr<StatementNode>> statements;
-
-    explicit BlockNode(vector<unique_ptr<StatementNode>> statements, unsigned int line, unsigned int column)
-        : statements(std::move(statements)) {
-            this->line = line;
-            this->column = column;
+    ArenaList<StatementNode*> statements;
+    // set by the resolver on bare blocks and function bodies, if and loop bodies share their enclosing scope
+    const ScopeLayout* layout = nullptr;
+
+    explicit BlockNode(ArenaList<StatementNode*> statements, uint32_t position)
+        : statements(statements) {
+            this->position = position;
+            this->kind = NodeKind::Block;
         }
-
-    virtual ~BlockNode() = default;
 };
 
 class AssignmentNode : public StatementNode {
 public:
-    string identifier;
-    unique_ptr<ExpressionNode> expression;
-
-    explicit AssignmentNode(string identifier, unique_ptr<ExpressionNode> expression, unsigned int line, unsigned int column)
-        : identifier(std::move(identifier)), expression(std::move(expression)) {
-            this->line = line;
-            this->column = column;
+    Symbol identifier;
+    // assignments always write the innermost scope
+    uint32_t slot = no_slot;
+    ExpressionNode* expression;
+
+    explicit AssignmentNode(Symbol identifier, ExpressionNode* expression, uint32_t position)
+        : identifier(identifier), expression(expression) {
+            this->position = position;
+            this->kind = NodeKind::Assignment;
         }
-    
-    virtual ~AssignmentNode() = default;
+};
+
+// operand types a binary operator of the tree walker saw, see Evaluator::binary_op. kept in the
+// padding after the operator, so nodes don't grow
+struct BinaryFeedback {
+    // what the node currently runs: still observing, the generic operator, or a specialized kernel
+    uint8_t state = 0;
+    // types of the last operands seen, and how many times in a row. once specialized, the types
+    // its kernel expects
+    uint8_t left_type = 0, right_type = 0;
+    uint8_t hits = 0;
+    uint8_t deoptimizations = 0;
 };
 
 class BinaryOpNode : public ExpressionNode {
 public:
     TokenType op;
-    unique_ptr<ExpressionNode> left;
-    unique_ptr<ExpressionNode> right;
-
-    explicit BinaryOpNode(TokenType op, unique_ptr<ExpressionNode> left, unique_ptr<ExpressionNode> right, unsigned int line, unsigned int column)
-        : op(op), left(std::move(left)), right(std::move(right)) {
-            this->line = line;
-            this->column = column;
+    mutable BinaryFeedback feedback;
+    ExpressionNode* left;
+    ExpressionNode* right;
+
+    explicit BinaryOpNode(TokenType op, ExpressionNode* left, ExpressionNode* right, uint32_t position)
+        : op(op), left(left), right(right) {
+            this->position = position;
+            this->kind = NodeKind::BinaryOp;
         }
-
-    virtual ~BinaryOpNode() = default;
 };
 
 class UnaryOpNode : public ExpressionNode {
 public:
     TokenType op;
-    unique_ptr<ExpressionNode> operand;
+    ExpressionNode* operand;
 
-    explicit UnaryOpNode(TokenType op, unique_ptr<ExpressionNode> operand, unsigned int line, unsigned int column)
-        : op(op), operand(std::move(operand)) {
-            this->line = line;
-            this->column = column;
+    explicit UnaryOpNode(TokenType op, ExpressionNode* operand, uint32_t position)
+        : op(op), operand(operand) {
+            this->position = position;
+            this->kind = NodeKind::UnaryOp;
         }
-
-    virtual ~UnaryOpNode() = default;
 };
 
 class VariableNode : public ExpressionNode {
 public:
-    string identifier;
-
-    explicit VariableNode(string identifier, unsigned int line, unsigned int column)
-        : identifier(std::move(identifier)) {
-            this->line = line;
-            this->column = column;
+    Symbol identifier;
+    // number of scopes between the innermost one and the one holding the slot. when the name isn't
+    // assigned anywhere up to the enclosing function, slot is no_slot and depth skips all those scopes
+    uint32_t depth = 0;
+    uint32_t slot = no_slot;
+
+    explicit VariableNode(Symbol identifier, uint32_t position)
+        : identifier(identifier) {
+            this->position = position;
+            this->kind = NodeKind::Variable;
         }
-
-    virtual ~VariableNode() = default;
 };
 
 class LiteralNode : public ExpressionNode {};
 
 class StringLiteral : public LiteralNode {
 public:
-    string value;
+    Symbol value;
 
-    explicit StringLiteral(string value, unsigned int line, unsigned int column)
-        : value(std::move(value)) {
-            this->line = line;
-            this->column = column;
+    explicit StringLiteral(Symbol value, uint32_t position)
+        : value(value) {
+            this->position = position;
+            this->kind = NodeKind::StringLiteral;
         }
-    virtual ~StringLiteral() = default;
 };
 
 class LongNumberLiteral : public LiteralNode {
 public:
     long value;
 
-    explicit LongNumberLiteral(long value, unsigned int line, unsigned int column)
+    explicit LongNumberLiteral(long value, uint32_t position)
         : value(value) {
-            this->line = line;
-            this->column = column;
+            this->position = position;
+            this->kind = NodeKind::LongNumberLiteral;
         }
-    virtual ~LongNumberLiteral() = default;
 };
 
 class DoubleNumberLiteral : public LiteralNode {
 public:
     double value;
 
-    explicit DoubleNumberLiteral(double value, unsigned int line, unsigned int column)
+    explicit DoubleNumberLiteral(double value, uint32_t position)
         : value(value) {
-            this->line = line;
-            this->column = column;
+            this->position = position;
+            this->kind = NodeKind::DoubleNumberLiteral;
         }
-    virtual ~DoubleNumberLiteral() = default;
 };
 
 class BoolLiteral : public LiteralNode {
 public:
     bool value;
 
-    explicit BoolLiteral(bool value, unsigned int line, unsigned int column)
+    explicit BoolLiteral(bool value, uint32_t position)
         : value(value) {
-            this->line = line;
-            this->column = column;
+            this->position = position;
+            this->kind = NodeKind::BoolLiteral;
         }
-    virtual ~BoolLiteral() = default;
 };
 
 class FunctionDefNode : public StatementNode {
 public:
-    string name;
-    vector<string> parameters;
-    unique_ptr<BlockNode> body;
-
-    explicit FunctionDefNode(string name, vector<string> parameters, unique_ptr<BlockNode> body, unsigned int ln, unsigned int col)
-        : name(std::move(name)), parameters(std::move(parameters)), body(std::move(body)) {
-            line = ln;
-            column = col;
+    Symbol name;
+    ArenaList<Symbol> parameters;
+    // null when the body was only pre-parsed, it is then parsed from body_source on the first call
+    BlockNode* body;
+    string_view body_source;
+    unsigned int body_line = 0, body_column = 0;
+    // calls counted by the JIT, see Jit::hot
+    mutable uint32_t hotness = 0;
+    // set by Purity when a call's result only depends on its arguments, calls can then be memoized
+    bool pure = false;
+
+    explicit FunctionDefNode(Symbol name, ArenaList<Symbol> parameters, BlockNode* body, uint32_t position)
+        : name(name), parameters(parameters), body(body) {
+            this->position = position;
+            this->kind = NodeKind::FunctionDef;
         }
-
-    virtual ~FunctionDefNode() = default;
 };
 
 class FunctionCallNode : public ExpressionNode {
 public:
-    string name;
-    vector<unique_ptr<ExpressionNode>> arguments;
+    Symbol name;
+    ArenaList<ExpressionNode*> arguments;
 
-    explicit FunctionCallNode(string name, vector<unique_ptr<ExpressionNode>> arguments, unsigned int ln, unsigned int col)
-        : name(std::move(name)), arguments(std::move(arguments)) {
-            line = ln;
-            column = col;
+    explicit FunctionCallNode(Symbol name, ArenaList<ExpressionNode*> arguments, uint32_t position)
+        : name(name), arguments(arguments) {
+            this->position = position;
+            this->kind = NodeKind::FunctionCall;
         }
-
-    virtual ~FunctionCallNode() = default;
 };
 
 class ExpressionStatementNode : public StatementNode {
 public:
-    unique_ptr<ExpressionNode> expression;
+    ExpressionNode* expression;
 
-    explicit ExpressionStatementNode(unique_ptr<ExpressionNode> expression, unsigned int line, unsigned int column)
-        : expression(std::move(expression)) {
-            this->line = line;
-            this->column = column;
+    explicit ExpressionStatementNode(ExpressionNode* expression, uint32_t position)
+        : expression(expression) {
+            this->position = position;
+            this->kind = NodeKind::ExpressionStatement;
         }
-
-    virtual ~ExpressionStatementNode() = default;
 };
 
 class ReturnNode : public StatementNode {
 public:
-    unique_ptr<ExpressionNode> expression;
-
-    explicit ReturnNode(unique_ptr<ExpressionNode> expression, unsigned int line, unsigned int column)
-        : expression(std::move(expression)) {
-            this->line = line;
-            this->column = column;
+    ExpressionNode* expression;
+    // set by the resolver when the expression is a call and the return is in its function's own
+    // scope, outside of any bare block. a call of the running function then reuses its frame
+    bool tail_call = false;
+
+    explicit ReturnNode(ExpressionNode* expression, uint32_t position)
+        : expression(expression) {
+            this->position = position;
+            this->kind = NodeKind::Return;
         }
-
-    virtual ~ReturnNode() = default;
 };
 
 class LoopNode : public StatementNode {
 public:
-    unique_ptr<ExpressionNode> condition;
-    unique_ptr<BlockNode> body;
-
-    explicit LoopNode(unique_ptr<ExpressionNode> condition, unique_ptr<BlockNode> body, unsigned int ln, unsigned int col)
-        : condition(std::move(condition)), body(std::move(body)) {
-            line = ln;
-            column = col;
+    ExpressionNode* condition;
+    BlockNode* body;
+    // iterations counted by the JIT, see Jit::hot
+    mutable uint32_t hotness = 0;
+
+    explicit LoopNode(ExpressionNode* condition, BlockNode* body, uint32_t position)
+        : condition(condition), body(body) {
+            this->position = position;
+            this->kind = NodeKind::Loop;
         }
-
-    virtual ~LoopNode() = default;
 };
 
 class IfElseNode : public StatementNode {
 public:
-    unique_ptr<ExpressionNode> condition;
-    unique_ptr<BlockNode> if_branch;
-    unique_ptr<BlockNode> else_branch;
-
-    explicit IfElseNode(unique_ptr<ExpressionNode> condition, unique_ptr<BlockNode> if_branch, unique_ptr<BlockNode> else_branch, unsigned int ln, unsigned int col)
-        : condition(std::move(condition)), if_branch(std::move(if_branch)), else_branch(std::move(else_branch)) {
-        line = ln;
-        column = col;
+    ExpressionNode* condition;
+    BlockNode* if_branch;
+    BlockNode* else_branch;
+
+    explicit IfElseNode(ExpressionNode* condition, BlockNode* if_branch, BlockNode* else_branch, uint32_t position)
+        : condition(condition), if_branch(if_branch), else_branch(else_branch) {
+        this->position = position;
+        this->kind = NodeKind::IfElse;
     }
-
-    virtual ~IfElseNode() = default;
 };
 
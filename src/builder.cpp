@@ -0,0 +1,533 @@
+#include <charconv>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "builder.hpp"
+
+using namespace std;
+
+// sources of the runtime the executables are linked with. the parser and the optimizer are only
+// there because Runtime::parse_body refers to them, generated programs are fully parsed and never call it
+static const char* const runtime_sources[] = {
+    "runtime.cpp", "environment.cpp", "symbols.cpp", "arena.cpp",
+    "parser.cpp", "lexer.cpp", "scan.cpp", "resolver.cpp", "optimizer.cpp",
+};
+
+// where the runtime sources are, the ones sia was built from unless SIA_RUNTIME_DIR says otherwise,
+// either in the environment or when building sia
+static string runtime_directory() {
+    if (const char* directory = getenv("SIA_RUNTIME_DIR")) return directory;
+#ifdef SIA_RUNTIME_DIR
+    return SIA_RUNTIME_DIR;
+#else
+    const string file = __FILE__;
+    const size_t slash = file.find_last_of('/');
+    return slash == string::npos ? "." : file.substr(0, slash);
+#endif
+}
+
+static string shell_quote(const string& text) {
+    string quoted = "'";
+    for (char c : text) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+NativeBuilder::NativeBuilder() : program_(nullptr), out_(nullptr), translating_(nullptr), tail_calls_(false), indent_(0), temporaries_(0) {}
+
+string NativeBuilder::translate(const ProgramNode& program, const string& filename) {
+    program_ = &program;
+    // natives are looked up by symbol, which interns their names in the program
+    runtime_.attach(program);
+    const string program_layout = layout(*program.layout);
+
+    ostringstream body;
+    out_ = &body;
+    indent_ = 1;
+    temporaries_ = 0;
+    body << "static Value program(NativeProgram& p) {\n";
+    // the top-level statements aren't a block, their errors aren't folded into "Error inside block"
+    translate_statements(program.statements);
+    body << "    return Value();\n}\n\n";
+
+    while (!pending_.empty()) {
+        const FunctionDefNode* definition = pending_.back();
+        pending_.pop_back();
+        translate_function(*definition);
+    }
+
+    ostringstream source;
+    source << "// generated by sia build from " << filename << "\n";
+    source << "#include <iostream>\n#include <stdexcept>\n#include <string>\n#include <string_view>\n#include <vector>\n\n";
+    source << "#include \"native.hpp\"\n\nusing namespace std;\n\n";
+
+    source << "static const string_view symbols[] = {\n";
+    for (size_t symbol = 0; symbol < program.symbols.size(); ++symbol) {
+        source << "    string_view(" << quote(program.symbols.name(symbol)) << ", " << program.symbols.name(symbol).size() << "),\n";
+    }
+    source << "};\n\n";
+    if (program.lines.size() > 0) {
+        source << "static const unsigned int lines[] = {\n";
+        for (uint32_t position = 0; position < program.lines.size(); ++position) {
+            source << "    " << program.lines.line(position) << ", " << program.lines.column(position) << ",\n";
+        }
+        source << "};\n\n";
+    }
+    source << declarations_.str() << "\n" << body.str() << functions_.str();
+
+    source << "int main() {\n";
+    source << "    try {\n";
+    source << "        NativeProgram p(symbols, " << program.symbols.size() << ", "
+           << (program.lines.size() > 0 ? "lines" : "nullptr") << ", " << program.lines.size() << ", " << program_layout << ");\n";
+    source << "        program(p);\n";
+    source << "    } catch (const runtime_error& e) {\n";
+    source << "        cerr << \" - \" << e.what() << endl;\n";
+    source << "    }\n";
+    source << "    return 0;\n";
+    source << "}\n";
+    return source.str();
+}
+
+void NativeBuilder::build(const ProgramNode& program, const string& filename, const string& output) {
+    const string source = translate(program, filename);
+
+    const char* temporary_directory = getenv("TMPDIR");
+    string path = string(temporary_directory ? temporary_directory : "/tmp") + "/sia-XXXXXX.cpp";
+    int file = mkstemps(path.data(), 4);
+    if (file < 0) throw runtime_error("Could not create " + path);
+    close(file);
+    ofstream(path) << source;
+
+    const char* compiler = getenv("CXX");
+    const string directory = runtime_directory();
+    string command = string(compiler ? compiler : "c++") + " -std=c++17 -O2 -pthread";
+    command += " -I" + shell_quote(directory) + " -o " + shell_quote(output) + " " + shell_quote(path);
+    for (const char* runtime_source : runtime_sources) {
+        command += " " + shell_quote(directory + "/" + runtime_source);
+    }
+    const int status = system(command.c_str());
+    remove(path.c_str());
+    if (status != 0) throw runtime_error("Could not compile " + filename + " into " + output);
+}
+
+void NativeBuilder::line(const string& code) {
+    *out_ << string(indent_ * 4, ' ') << code << '\n';
+}
+
+string NativeBuilder::temporary() {
+    return "t" + to_string(temporaries_++);
+}
+
+string NativeBuilder::layout(const ScopeLayout& layout) {
+    auto [it, inserted] = layouts_.try_emplace(&layout, layouts_.size());
+    const string name = "layout_" + to_string(it->second);
+    if (!inserted) return name;
+
+    string names = "ArenaList<Symbol>()", parameters = "ArenaList<uint32_t>()";
+    if (!layout.names.empty()) {
+        declarations_ << "static Symbol " << name << "_names[] = {";
+        for (Symbol symbol : layout.names) declarations_ << " " << symbol << ",";
+        declarations_ << " };\n";
+        names = "ArenaList<Symbol>(" + name + "_names, " + to_string(layout.names.size()) + ")";
+    }
+    if (!layout.parameters.empty()) {
+        declarations_ << "static uint32_t " << name << "_parameters[] = {";
+        for (uint32_t slot : layout.parameters) declarations_ << " " << slot << ",";
+        declarations_ << " };\n";
+        parameters = "ArenaList<uint32_t>(" + name + "_parameters, " + to_string(layout.parameters.size()) + ")";
+    }
+    declarations_ << "static const ScopeLayout " << name << " = { " << names << ", " << parameters << " };\n";
+    return name;
+}
+
+string NativeBuilder::function(const FunctionDefNode& definition) {
+    auto [it, inserted] = function_ids_.try_emplace(&definition, function_ids_.size());
+    const string name = "function_" + to_string(it->second);
+    if (inserted) {
+        declarations_ << "static Value " << name << "(NativeProgram& p);\n";
+        pending_.push_back(&definition);
+    }
+    return name;
+}
+
+// literals are built once and then shared by every evaluation, like Runtime::string_literal
+string NativeBuilder::string_literal(Symbol symbol) {
+    const string name = "literal_" + to_string(symbol);
+    if (symbol >= string_literals_.size()) string_literals_.resize(symbol + 1);
+    if (!string_literals_[symbol]) {
+        string_literals_[symbol] = true;
+        const string_view text = program_->symbols.name(symbol);
+        declarations_ << "static const Value " << name << " = Value(string(" << quote(text) << ", " << text.size() << "));\n";
+    }
+    return name;
+}
+
+// temporaries are used once, so they are moved to where they go
+string NativeBuilder::take(const operand& value) {
+    return value.kind == operand::temporary ? "std::move(" + value.code + ")" : value.code;
+}
+
+string NativeBuilder::quote(string_view text) {
+    string quoted = "\"";
+    for (unsigned char c : text) {
+        // a ? is escaped too, so ??= or ??/ in a literal isn't read as a trigraph
+        if (c == '"' || c == '\\' || c == '?') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c >= 0x20 && c < 0x7f) {
+            quoted += c;
+        } else {
+            // always three octal digits, so the next character can't be read as part of the escape
+            char escape[5];
+            snprintf(escape, sizeof(escape), "\\%03o", c);
+            quoted += escape;
+        }
+    }
+    return quoted + "\"";
+}
+
+string NativeBuilder::operator_name(TokenType op) {
+    switch (op) {
+        case TokenType::MULTIPLY : return "TokenType::MULTIPLY";
+        case TokenType::DIVIDE : return "TokenType::DIVIDE";
+        case TokenType::MODULO : return "TokenType::MODULO";
+        case TokenType::PLUS : return "TokenType::PLUS";
+        case TokenType::MINUS : return "TokenType::MINUS";
+        case TokenType::LESS_THAN : return "TokenType::LESS_THAN";
+        case TokenType::GREATER_THAN : return "TokenType::GREATER_THAN";
+        case TokenType::LESS_EQUAL : return "TokenType::LESS_EQUAL";
+        case TokenType::GREATER_EQUAL : return "TokenType::GREATER_EQUAL";
+        case TokenType::EQUAL : return "TokenType::EQUAL";
+        case TokenType::NOT_EQUAL : return "TokenType::NOT_EQUAL";
+        case TokenType::LOGICAL_AND : return "TokenType::LOGICAL_AND";
+        case TokenType::LOGICAL_OR : return "TokenType::LOGICAL_OR";
+        // the runtime reports the invalid operator when the node is evaluated
+        default: return "TokenType(" + to_string(static_cast<int>(op)) + ")";
+    }
+}
+
+void NativeBuilder::translate_function(const FunctionDefNode& definition) {
+    if (!definition.body) throw runtime_error("Function bodies have to be parsed before they are built");
+
+    ostringstream body;
+    out_ = &body;
+    indent_ = 1;
+    temporaries_ = 0;
+    translating_ = &definition;
+    tail_calls_ = false;
+    translate_block(*definition.body, false);
+    translating_ = nullptr;
+    functions_ << "static Value " << function(definition) << "(NativeProgram& p) {\n";
+    if (tail_calls_) functions_ << "start:\n";
+    functions_ << body.str() << "    return Value();\n}\n\n";
+}
+
+void NativeBuilder::translate_statements(const ArenaList<StatementNode*>& statements) {
+    for (const auto& statement : statements) {
+        translate_statement(*statement);
+    }
+}
+
+// mirrors Evaluator::evaluate_block, errors inside the block are reported at the block
+void NativeBuilder::translate_block(const BlockNode& block, bool new_scope) {
+    if (new_scope) line("p.environment.push(" + layout(*block.layout) + ");");
+    line("try {");
+    indent_++;
+    translate_statements(block.statements);
+    indent_--;
+    line("} catch (const runtime_error&) {");
+    line("    throw p.block_error(" + to_string(block.position) + ");");
+    line("}");
+    if (new_scope) line("p.environment.pop();");
+}
+
+void NativeBuilder::translate_statement(const StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block:
+        line("{");
+        indent_++;
+        translate_block(static_cast<const BlockNode&>(statement), true);
+        indent_--;
+        line("}");
+        break;
+
+    case NodeKind::Assignment:
+        translate_assignment(static_cast<const AssignmentNode&>(statement));
+        break;
+
+    case NodeKind::Loop:
+        translate_loop(static_cast<const LoopNode&>(statement));
+        break;
+
+    case NodeKind::IfElse:
+        translate_if_else(static_cast<const IfElseNode&>(statement));
+        break;
+
+    case NodeKind::FunctionDef: {
+        auto& definition = static_cast<const FunctionDefNode&>(statement);
+        if (!definition.body) throw runtime_error("Function bodies have to be parsed before they are built");
+        line("p.define(" + to_string(definition.name) + ", " + layout(*definition.body->layout) + ", " + function(definition) + ");");
+        break;
+    }
+    case NodeKind::ExpressionStatement: {
+        line("{");
+        indent_++;
+        operand value = translate_expression(*static_cast<const ExpressionStatementNode&>(statement).expression);
+        // a read still has to fail on an undefined variable
+        if (value.kind == operand::read) line("(void)" + value.code + ";");
+        indent_--;
+        line("}");
+        break;
+    }
+    case NodeKind::Return: {
+        // the scopes a return leaves are popped by the caller, see NativeProgram::invoke
+        auto& my_return = static_cast<const ReturnNode&>(statement);
+        if (!my_return.expression) {
+            line("return Value();");
+            break;
+        }
+        if (my_return.tail_call && !runtime_.native(static_cast<const FunctionCallNode&>(*my_return.expression).name)) {
+            translate_tail_call(static_cast<const FunctionCallNode&>(*my_return.expression));
+            break;
+        }
+        line("{");
+        indent_++;
+        operand value = translate_expression(*my_return.expression);
+        line("return " + take(value) + ";");
+        indent_--;
+        line("}");
+        break;
+    }
+    default:
+        throw runtime_error("Unknown statement");
+    }
+}
+
+void NativeBuilder::translate_assignment(const AssignmentNode& assignment) {
+    const string slot = to_string(assignment.slot);
+    line("{");
+    indent_++;
+    if (Runtime::is_append(assignment)) {
+        // same as Evaluator::append_in_place: when s holds a string, the operands are evaluated
+        // first and then appended to s
+        vector<const ExpressionNode*> operands;
+        for (const ExpressionNode* expression = assignment.expression; expression->kind == NodeKind::BinaryOp;
+             expression = static_cast<const BinaryOpNode*>(expression)->left) {
+            operands.push_back(static_cast<const BinaryOpNode*>(expression)->right);
+        }
+        const string name = temporary();
+        line("if (p.environment.local(" + slot + ").is_string()) {");
+        indent_++;
+        line("Value " + name + "[" + to_string(operands.size()) + "];");
+        for (size_t i = 0; i < operands.size(); ++i) {
+            operand value = translate_expression(*operands[operands.size() - 1 - i]);
+            line(name + "[" + to_string(i) + "] = " + take(value) + ";");
+        }
+        line("Value& target = p.environment.local(" + slot + ");");
+        line("target = p.runtime.append(std::move(target), " + name + ", " + to_string(operands.size()) + ", " + to_string(assignment.position) + ");");
+        indent_--;
+        line("} else {");
+        indent_++;
+    }
+    operand value = translate_expression(*assignment.expression);
+    line("p.environment.set(" + slot + ", " + take(value) + ");");
+    if (Runtime::is_append(assignment)) {
+        indent_--;
+        line("}");
+    }
+    indent_--;
+    line("}");
+}
+
+// mirrors Evaluator::evaluate_loop, the count is converted with to_long
+void NativeBuilder::translate_loop(const LoopNode& loop) {
+    if (!loop.condition) throw runtime_error(runtime_.error_message("Expected a loop count", loop.position));
+    line("{");
+    indent_++;
+    operand count = translate_expression(*loop.condition);
+    const string name = temporary(), index = temporary();
+    line("const long " + name + " = p.runtime.to_long(" + count.code + ", " + to_string(loop.position) + ");");
+    line("for (long " + index + " = 0; " + index + " < " + name + "; ++" + index + ") {");
+    indent_++;
+    translate_block(*loop.body, false);
+    indent_--;
+    line("}");
+    indent_--;
+    line("}");
+}
+
+void NativeBuilder::translate_if_else(const IfElseNode& if_else) {
+    if (!if_else.condition) throw runtime_error(runtime_.error_message("Expected a condition", if_else.position));
+    line("{");
+    indent_++;
+    operand condition = translate_expression(*if_else.condition);
+    line("if (p.runtime.to_boolean(" + condition.code + ", " + to_string(if_else.position) + ")) {");
+    indent_++;
+    translate_block(*if_else.if_branch, false);
+    indent_--;
+    if (if_else.else_branch) {
+        line("} else {");
+        indent_++;
+        translate_block(*if_else.else_branch, false);
+        indent_--;
+    }
+    line("}");
+    indent_--;
+    line("}");
+}
+
+bool NativeBuilder::is_plain_read(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::Variable:
+    case NodeKind::StringLiteral:
+    case NodeKind::LongNumberLiteral:
+    case NodeKind::DoubleNumberLiteral:
+    case NodeKind::BoolLiteral:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// emits the statements computing an expression and returns how to refer to its value. reads are
+// left to the point of use, so nothing may be emitted between the two
+NativeBuilder::operand NativeBuilder::translate_expression(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+        return { operand::constant, string_literal(static_cast<const StringLiteral&>(expression).value) };
+
+    case NodeKind::LongNumberLiteral: {
+        // the optimizer may fold a literal to LONG_MIN, whose negation doesn't fit in a long
+        const long value = static_cast<const LongNumberLiteral&>(expression).value;
+        if (value == LONG_MIN) return { operand::constant, "Value(-9223372036854775807L - 1)" };
+        return { operand::constant, "Value(" + to_string(value) + "L)" };
+    }
+
+    case NodeKind::DoubleNumberLiteral: {
+        // the shortest text that reads back as the same double
+        char buffer[64];
+        string text(buffer, to_chars(buffer, buffer + sizeof(buffer), static_cast<const DoubleNumberLiteral&>(expression).value).ptr);
+        if (text.find_first_of(".e") == string::npos) text += ".0";
+        return { operand::constant, "Value(" + text + ")" };
+    }
+    case NodeKind::BoolLiteral:
+        return { operand::constant, static_cast<const BoolLiteral&>(expression).value ? "Value(true)" : "Value(false)" };
+
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        const string slot = variable.slot == no_slot ? "no_slot" : to_string(variable.slot);
+        return { operand::read, "p.read(" + to_string(variable.depth) + ", " + slot + ", " + to_string(variable.identifier) + ")" };
+    }
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        if (Runtime::is_short_circuit(binary.op)) return translate_short_circuit(binary);
+        operand left = translate_expression(*binary.left);
+        if (left.kind == operand::read) {
+            // read before the right operand, like the tree walker. it is only borrowed when
+            // nothing can grow the value stack before the operator runs
+            const string name = temporary();
+            line((is_plain_read(*binary.right) ? "const Value& " : "Value ") + name + " = " + left.code + ";");
+            left = { operand::temporary, name };
+        }
+        operand right = translate_expression(*binary.right);
+        const string name = temporary();
+        line("Value " + name + " = p.runtime.binary_op(" + operator_name(binary.op) + ", " + left.code + ", " + right.code + ", " + to_string(binary.position) + ");");
+        return { operand::temporary, name };
+    }
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        operand value = translate_expression(*unary.operand);
+        const string name = temporary();
+        line("Value " + name + " = p.runtime.unary_op(" + operator_name(unary.op) + ", " + value.code + ", " + to_string(unary.position) + ");");
+        return { operand::temporary, name };
+    }
+    case NodeKind::FunctionCall:
+        return translate_call(static_cast<const FunctionCallNode&>(expression));
+
+    default:
+        throw runtime_error("Unknown expression");
+    }
+}
+
+// mirrors Evaluator::short_circuit, the right operand is translated inside the branch that runs it
+NativeBuilder::operand NativeBuilder::translate_short_circuit(const BinaryOpNode& binary) {
+    const string position = to_string(binary.position);
+    operand left = translate_expression(*binary.left);
+    const string name = temporary();
+    line("Value " + name + "(p.runtime.to_boolean(" + left.code + ", " + position + "));");
+    line(string("if (") + (binary.op == TokenType::LOGICAL_AND ? "" : "!") + name + ".as_bool()) {");
+    indent_++;
+    operand right = translate_expression(*binary.right);
+    line(name + " = Value(p.runtime.to_boolean(" + right.code + ", " + position + "));");
+    indent_--;
+    line("}");
+    return { operand::temporary, name };
+}
+
+// mirrors Evaluator::evaluate_function_call. natives are fixed, user functions are looked up
+// when the call runs since a definition is a statement
+NativeBuilder::operand NativeBuilder::translate_call(const FunctionCallNode& call) {
+    const string position = to_string(call.position);
+    const string name = temporary();
+    if (runtime_.native(call.name)) {
+        line("vector<Value> " + name + ";");
+        for (const auto& argument : call.arguments) {
+            operand value = translate_expression(*argument);
+            line(name + ".push_back(" + take(value) + ");");
+        }
+        const string result = temporary();
+        line("Value " + result + " = (*p.runtime.native(" + to_string(call.name) + "))(" + name + ", " + position + ");");
+        return { operand::temporary, result };
+    }
+
+    // arguments are evaluated in the caller's scope, straight into the slots of the callee's
+    const string base = temporary();
+    line("const NativeProgram::function " + name + " = p.callee(" + to_string(call.name) + ", " + to_string(call.arguments.size()) + ", " + position + ");");
+    line("const size_t " + base + " = p.environment.reserve(*" + name + ".layout);");
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        operand value = translate_expression(*call.arguments[i]);
+        line("p.environment.slot(" + base + ", " + name + ".layout->parameters[" + to_string(i) + "]) = " + take(value) + ";");
+    }
+    const string result = temporary();
+    line("Value " + result + " = p.invoke(" + name + ", " + base + ");");
+    return { operand::temporary, result };
+}
+
+// same as Evaluator::tail_call: when the callee is the function being run, the arguments overwrite
+// its parameters and it starts over, leaving the scope and the try blocks it is in as they are
+void NativeBuilder::translate_tail_call(const FunctionCallNode& call) {
+    const string name = temporary();
+    line("{");
+    indent_++;
+    line("const NativeProgram::function " + name + " = p.callee(" + to_string(call.name) + ", " + to_string(call.arguments.size()) + ", " + to_string(call.position) + ");");
+    vector<string> arguments;
+    for (const auto& argument : call.arguments) {
+        operand value = translate_expression(*argument);
+        arguments.push_back(temporary());
+        line("Value " + arguments.back() + " = " + take(value) + ";");
+    }
+    tail_calls_ = true;
+    const ArenaList<uint32_t>& parameters = translating_->body->layout->parameters;
+    line("if (" + name + ".body == " + function(*translating_) + ") {");
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        line("    p.environment.local(" + to_string(parameters[i]) + ") = std::move(" + arguments[i] + ");");
+    }
+    line("    goto start;");
+    line("}");
+    const string base = temporary();
+    line("const size_t " + base + " = p.environment.reserve(*" + name + ".layout);");
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        line("p.environment.slot(" + base + ", " + name + ".layout->parameters[" + to_string(i) + "]) = std::move(" + arguments[i] + ");");
+    }
+    line("return p.invoke(" + name + ", " + base + ");");
+    indent_--;
+    line("}");
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "runtime.hpp"
+#include "symbols.hpp"
+#include "token.hpp"
+
+using namespace std;
+
+// ahead-of-time compiler behind `sia build`. a fully parsed and resolved tree is translated to
+// C++ that runs on NativeProgram, which is then compiled and linked with the runtime sources by
+// the system compiler. the executable prints and fails exactly like the tree walker
+class NativeBuilder {
+public:
+    NativeBuilder();
+    // the program must be parsed with every function body, the generated code never parses
+    string translate(const ProgramNode& program, const string& filename);
+    // translates the program and compiles it into the executable output
+    void build(const ProgramNode& program, const string& filename, const string& output);
+    virtual ~NativeBuilder() = default;
+
+private:
+    // how the generated code refers to the value of an expression
+    struct operand {
+        enum kind { constant, read, temporary } kind;
+        string code;
+    };
+
+    const ProgramNode* program_;
+    // only asked which names are native functions
+    Runtime runtime_;
+
+    // static tables and forward declarations, then the code of every function
+    ostringstream declarations_;
+    ostringstream functions_;
+    // code of the function being translated
+    ostringstream* out_;
+    // null for the top-level code. a tail call of the function itself jumps back to its start
+    const FunctionDefNode* translating_;
+    bool tail_calls_;
+    unsigned int indent_;
+    unsigned int temporaries_;
+
+    unordered_map<const ScopeLayout*, size_t> layouts_;
+    unordered_map<const FunctionDefNode*, size_t> function_ids_;
+    // definitions met in the bodies translated so far, whose own body is still to be translated
+    vector<const FunctionDefNode*> pending_;
+    vector<bool> string_literals_;
+
+    void line(const string& code);
+    string temporary();
+    string layout(const ScopeLayout& layout);
+    string function(const FunctionDefNode& definition);
+    string string_literal(Symbol symbol);
+    static string take(const operand& value);
+    static string quote(string_view text);
+    static string operator_name(TokenType op);
+
+    void translate_function(const FunctionDefNode& definition);
+    void translate_statements(const ArenaList<StatementNode*>& statements);
+    void translate_block(const BlockNode& block, bool new_scope);
+    void translate_statement(const StatementNode& statement);
+    void translate_assignment(const AssignmentNode& assignment);
+    void translate_loop(const LoopNode& loop);
+    void translate_if_else(const IfElseNode& if_else);
+
+    static bool is_plain_read(const ExpressionNode& expression);
+    operand translate_expression(const ExpressionNode& expression);
+    operand translate_short_circuit(const BinaryOpNode& binary);
+    operand translate_call(const FunctionCallNode& call);
+    void translate_tail_call(const FunctionCallNode& call);
+};
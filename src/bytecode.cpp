@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <string>
+
+#include "bytecode.hpp"
+
+using namespace std;
+
+const char* opcode_name(OpCode op) {
+    static const char* const names[] = {
+#define SIA_OPCODE_NAME(name) #name,
+        SIA_OPCODES(SIA_OPCODE_NAME)
+#undef SIA_OPCODE_NAME
+    };
+    return names[static_cast<size_t>(op)];
+}
+
+// one instruction per line: index, opcode, operands and what they refer to
+void disassemble(const Chunk& chunk, const Bytecode& bytecode, const ProgramNode& program, ostream& out) {
+    for (size_t i = 0; i < chunk.code.size(); ++i) {
+        const Instruction& instruction = chunk.code[i];
+        char line[64];
+        snprintf(line, sizeof(line), "%04zu  %-26s %6u %6u", i, opcode_name(instruction.op), instruction.a, instruction.b);
+        out << line;
+
+        switch (instruction.op) {
+        case OpCode::CONSTANT: {
+            const Value& value = bytecode.constants[instruction.a];
+            string text;
+            if (value.is_string()) {
+                text = "\"" + value.as_string() + "\"";
+            } else if (value.is_long()) {
+                text = to_string(value.as_long());
+            } else if (value.is_double()) {
+                text = to_string(value.as_double());
+            } else if (value.is_bool()) {
+                text = value.as_bool() ? "true" : "false";
+            }
+            out << "    ; " << text;
+            break;
+        }
+        case OpCode::LOAD_LOCAL:
+        case OpCode::LOAD_VARIABLE: {
+            auto variable = static_cast<const VariableNode*>(bytecode.nodes[instruction.b]);
+            out << "    ; " << program.symbols.name(variable->identifier);
+            if (instruction.op == OpCode::LOAD_VARIABLE) {
+                if (variable->slot == no_slot) {
+                    out << " (by name, " << variable->depth << " scopes up)";
+                } else {
+                    out << " (" << variable->depth << " scopes up, slot " << variable->slot << ")";
+                }
+            }
+            break;
+        }
+        case OpCode::BINARY:
+        case OpCode::UNARY:
+            out << "    ; token " << instruction.a;
+            break;
+        case OpCode::DEFINE: {
+            auto function = static_cast<const FunctionDefNode*>(bytecode.nodes[instruction.a]);
+            out << "    ; " << program.symbols.name(function->name);
+            break;
+        }
+        case OpCode::PREPARE_CALL: {
+            auto call = static_cast<const FunctionCallNode*>(bytecode.nodes[instruction.a]);
+            out << "    ; " << program.symbols.name(call->name);
+            break;
+        }
+        default:
+            break;
+        }
+        out << "\n";
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "ast.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// a: first operand, b: second operand, c: position of the node for errors
+#define SIA_OPCODES(X) \
+    X(CONSTANT)                 /* a: constant */ \
+    X(LOAD_LOCAL)               /* a: slot of the innermost scope, b: variable, looked up by name while unset */ \
+    X(LOAD_VARIABLE)            /* b: variable, looked up along the scopes */ \
+    X(STORE_LOCAL)              /* a: slot of the innermost scope */ \
+    X(JUMP_UNLESS_LOCAL_STRING) /* a: slot, b: target */ \
+    X(APPEND_LOCAL)             /* a: slot, b: number of operands appended to the string it holds */ \
+    X(POP) \
+    X(ADD) \
+    X(SUBTRACT) \
+    X(MULTIPLY) \
+    X(DIVIDE) \
+    X(MODULO) \
+    X(LESS) \
+    X(GREATER) \
+    X(LESS_EQUAL) \
+    X(GREATER_EQUAL) \
+    X(EQUAL) \
+    X(NOT_EQUAL) \
+    X(BINARY)                   /* a: any other operator token */ \
+    X(UNARY)                    /* a: operator token */ \
+    X(JUMP)                     /* a: target */ \
+    X(JUMP_IF_FALSE)            /* a: target */ \
+    X(SHORT_CIRCUIT)            /* a: target, b: 1 for or, 0 for and. jumps with the truth of the value on top when it decides, pops it otherwise */ \
+    X(TRUTH)                    /* the value on top becomes its truth */ \
+    X(LOOP_COUNT)               /* turns the loop's expression into its number of iterations */ \
+    X(LOOP_NEXT)                /* a: target once the count on top of the stack is spent */ \
+    X(ENTER_SCOPE)              /* a: bare block */ \
+    X(EXIT_SCOPE) \
+    X(DEFINE)                   /* a: function definition */ \
+    X(CALL_NATIVE)              /* a: native function, b: number of arguments */ \
+    X(PREPARE_CALL)             /* a: call, reserves the callee's scope */ \
+    X(ARGUMENT)                 /* a: parameter the value on top of the stack is moved to */ \
+    X(CALL) \
+    X(TAIL_CALL)                /* a call in a return: the running function calling itself starts over in its frame, anything else is a CALL */ \
+    X(RETURN) \
+    X(RETURN_NULL)
+
+enum class OpCode : unsigned char {
+#define SIA_OPCODE_ENUM(name) name,
+    SIA_OPCODES(SIA_OPCODE_ENUM)
+#undef SIA_OPCODE_ENUM
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t a, b, c;
+};
+
+// code of a function body, or of the program's top-level statements
+struct Chunk {
+    // instructions [begin, end) of a block of top-level code, errors raised there are reported at the block
+    struct block_range {
+        uint32_t begin, end;
+        uint32_t position;
+    };
+
+    vector<Instruction> code;
+    // deepest the operand stack gets while running it
+    uint32_t max_stack = 0;
+    // null for the program
+    const BlockNode* body = nullptr;
+    // outermost blocks only, the body already covers everything in a function
+    vector<block_range> blocks;
+};
+
+// constants and nodes that instructions refer to by index, shared by every chunk of a program
+struct Bytecode {
+    vector<Value> constants;
+    vector<const ASTNode*> nodes;
+    vector<const native_function*> natives;
+};
+
+const char* opcode_name(OpCode op);
+void disassemble(const Chunk& chunk, const Bytecode& bytecode, const ProgramNode& program, ostream& out);
@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "closures.hpp"
+
+using namespace std;
+
+ClosureEvaluator::ClosureEvaluator() : calls_(0), tail_calls_(0), depth_(0), peak_depth_(0), running_(nullptr) {}
+
+void ClosureEvaluator::evaluate(const ProgramNode& program) {
+    runtime_.attach(program);
+    functions_.resize(program.symbols.size());
+    vector<statement_closure> statements = compile_statements(program.statements);
+
+    environment_.push(*program.layout);
+    for (const auto& statement : statements) {
+        // a return outside of any function ends the program
+        if (statement() == completion::returned) break;
+    }
+    environment_.pop();
+}
+
+void ClosureEvaluator::print_stats(ostream& out) const {
+    const auto& environment = environment_.statistics();
+    out << "calls: " << calls_ << endl;
+    out << "tail calls: " << tail_calls_ << endl;
+    out << "peak call depth: " << peak_depth_ << endl;
+    out << "scopes: " << environment.scopes << endl;
+    out << "value stack growths: " << environment.growths << endl;
+    out << "peak stack slots: " << environment.peak_slots << endl;
+}
+
+const Value& ClosureEvaluator::get_variable(const VariableNode& variable) {
+    const Value* value = environment_.find(variable);
+    if (!value) throw runtime_.undefined_variable(variable.identifier);
+    return *value;
+}
+
+// a variable the innermost scope assigns, read straight from its slot once it holds a value
+const Value& ClosureEvaluator::get_local(const VariableNode& variable) {
+    const Value& value = environment_.local(variable.slot);
+    if (!value.is_unset()) return value;
+    return get_variable(variable);
+}
+
+ClosureEvaluator::completion ClosureEvaluator::run_block(const vector<statement_closure>& statements, const BlockNode& block) {
+    completion result = completion::normal;
+    try {
+        for (const auto& statement : statements) {
+            result = statement();
+            if (result != completion::normal) break;
+        }
+    } catch (const syntax_error& e) {
+        throw;
+    } catch (const runtime_error& e) {
+        throw runtime_error(runtime_.error_message("Error inside block", block.position));
+    }
+    return result;
+}
+
+Value ClosureEvaluator::call(const FunctionCallNode& call, const vector<expression_closure>& arguments) {
+    if (call.name >= functions_.size() || !functions_[call.name].definition) {
+        throw runtime_error(runtime_.error_message("Undefined function : " + string(runtime_.program().symbols.name(call.name)), call.position));
+    }
+    function_entry& function = functions_[call.name];
+    if (call.arguments.size() != function.definition->parameters.size()) {
+        throw runtime_error(runtime_.error_message("Argument count mismatch", call.position));
+    }
+    if (!function.body) {
+        const BlockNode* body = function.definition->body ? function.definition->body : runtime_.parse_body(*function.definition);
+        auto it = bodies_.find(body);
+        if (it == bodies_.end()) it = bodies_.emplace(body, compiled_body{ body, compile_statements(body->statements) }).first;
+        function.body = &it->second;
+    }
+
+    calls_++;
+    // the entry may move while the arguments or the body run, if they define new functions
+    const FunctionDefNode* definition = function.definition;
+    const compiled_body& body = *function.body;
+    const ScopeLayout& layout = *body.block->layout;
+    // arguments are evaluated in the caller's scope, straight into the slots of the callee's
+    size_t base = environment_.reserve(layout);
+    for (size_t i = 0; i < arguments.size(); ++i) {
+        Value value = arguments[i]();
+        environment_.slot(base, layout.parameters[i]) = std::move(value);
+    }
+    environment_.enter(layout, base);
+
+    const FunctionDefNode* caller = running_;
+    running_ = definition;
+    size_t frames = 1;
+    peak_depth_ = max(peak_depth_, ++depth_);
+    completion result = run_block(body.statements, *body.block);
+    while (result == completion::tail_call) {
+        frames++;
+        peak_depth_ = max(peak_depth_, ++depth_);
+        result = run_block(body.statements, *body.block);
+    }
+    depth_ -= frames;
+    running_ = caller;
+    environment_.pop();
+    if (result == completion::returned) return std::move(return_value_);
+    return Value();
+}
+
+// same as Evaluator::tail_call
+bool ClosureEvaluator::tail_call(const FunctionCallNode& call, const vector<expression_closure>& arguments) {
+    if (call.name >= functions_.size()) return false;
+    const FunctionDefNode* definition = functions_[call.name].definition;
+    if (!definition || definition != running_ || arguments.size() != definition->parameters.size()) return false;
+
+    calls_++;
+    tail_calls_++;
+    const size_t mark = tail_arguments_.size();
+    for (const auto& argument : arguments) {
+        Value value = argument();
+        tail_arguments_.push_back(std::move(value));
+    }
+    const BlockNode* body = definition->body ? definition->body : runtime_.parse_body(*definition);
+    const ArenaList<uint32_t>& parameters = body->layout->parameters;
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        environment_.local(parameters[i]) = std::move(tail_arguments_[mark + i]);
+    }
+    tail_arguments_.resize(mark);
+    return true;
+}
+
+vector<ClosureEvaluator::statement_closure> ClosureEvaluator::compile_statements(const ArenaList<StatementNode*>& statements) {
+    vector<statement_closure> closures;
+    closures.reserve(statements.size());
+    for (const auto& statement : statements) {
+        closures.push_back(compile_statement(*statement));
+    }
+    return closures;
+}
+
+// body of a bare block, a loop or an if
+ClosureEvaluator::statement_closure ClosureEvaluator::compile_block(const BlockNode& block, bool new_scope) {
+    vector<statement_closure> statements = compile_statements(block.statements);
+    if (!new_scope) {
+        return [this, &block, statements = std::move(statements)]() {
+            return run_block(statements, block);
+        };
+    }
+    return [this, &block, statements = std::move(statements)]() {
+        environment_.push(*block.layout);
+        completion result = run_block(statements, block);
+        environment_.pop();
+        return result;
+    };
+}
+
+ClosureEvaluator::statement_closure ClosureEvaluator::compile_statement(const StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block:
+        return compile_block(static_cast<const BlockNode&>(statement), true);
+
+    case NodeKind::Assignment:
+        return compile_assignment(static_cast<const AssignmentNode&>(statement));
+
+    case NodeKind::Loop:
+        return compile_loop(static_cast<const LoopNode&>(statement));
+
+    case NodeKind::IfElse:
+        return compile_if_else(static_cast<const IfElseNode&>(statement));
+
+    case NodeKind::FunctionDef: {
+        auto& definition = static_cast<const FunctionDefNode&>(statement);
+        return [this, &definition]() {
+            // bodies parsed on their first call may bring new names
+            if (definition.name >= functions_.size()) functions_.resize(runtime_.program().symbols.size());
+            functions_[definition.name] = { &definition, nullptr };
+            return completion::normal;
+        };
+    }
+    case NodeKind::ExpressionStatement: {
+        expression_closure expression = compile_expression(*static_cast<const ExpressionStatementNode&>(statement).expression);
+        return [expression = std::move(expression)]() {
+            expression();
+            return completion::normal;
+        };
+    }
+    case NodeKind::Return: {
+        auto& my_return = static_cast<const ReturnNode&>(statement);
+        if (!my_return.expression) {
+            return [this]() {
+                return_value_ = Value();
+                return completion::returned;
+            };
+        }
+        if (my_return.tail_call) {
+            auto& call = static_cast<const FunctionCallNode&>(*my_return.expression);
+            if (!runtime_.native(call.name)) {
+                vector<expression_closure> arguments;
+                for (const auto& argument : call.arguments) {
+                    arguments.push_back(compile_expression(*argument));
+                }
+                return [this, &call, arguments = std::move(arguments)]() {
+                    if (tail_call(call, arguments)) return completion::tail_call;
+                    return_value_ = this->call(call, arguments);
+                    return completion::returned;
+                };
+            }
+        }
+        expression_closure expression = compile_expression(*my_return.expression);
+        return [this, expression = std::move(expression)]() {
+            return_value_ = expression();
+            return completion::returned;
+        };
+    }
+    default:
+        throw runtime_error("Unknown statement");
+    }
+}
+
+ClosureEvaluator::statement_closure ClosureEvaluator::compile_assignment(const AssignmentNode& assignment) {
+    const uint32_t slot = assignment.slot;
+    expression_closure expression = compile_expression(*assignment.expression);
+    if (!Runtime::is_append(assignment)) {
+        return [this, slot, expression = std::move(expression)]() {
+            environment_.set(slot, expression());
+            return completion::normal;
+        };
+    }
+
+    // while s holds a string every + of s = s + a + b ... concatenates, a, b ... are
+    // evaluated first and then appended to s
+    vector<expression_closure> operands;
+    const ExpressionNode* chain = assignment.expression;
+    while (chain->kind == NodeKind::BinaryOp) {
+        auto binary = static_cast<const BinaryOpNode*>(chain);
+        operands.insert(operands.begin(), compile_expression(*binary->right));
+        chain = binary->left;
+    }
+    const uint32_t position = assignment.position;
+    return [this, slot, position, expression = std::move(expression), operands = std::move(operands)]() {
+        if (!environment_.local(slot).is_string()) {
+            environment_.set(slot, expression());
+            return completion::normal;
+        }
+        const size_t mark = append_operands_.size();
+        for (const auto& operand : operands) {
+            Value value = operand();
+            append_operands_.push_back(std::move(value));
+        }
+        Value& target = environment_.local(slot);
+        target = runtime_.append(std::move(target), append_operands_.data() + mark, append_operands_.size() - mark, position);
+        append_operands_.resize(mark);
+        return completion::normal;
+    };
+}
+
+ClosureEvaluator::statement_closure ClosureEvaluator::compile_loop(const LoopNode& loop) {
+    expression_closure condition = compile_expression(*loop.condition);
+    vector<statement_closure> body = compile_statements(loop.body->statements);
+    return [this, &loop, condition = std::move(condition), body = std::move(body)]() {
+        long count = runtime_.to_long(condition(), loop.position);
+        for (long i = 0; i < count; ++i) {
+            completion result = run_block(body, *loop.body);
+            if (result != completion::normal) return result;
+        }
+        return completion::normal;
+    };
+}
+
+ClosureEvaluator::statement_closure ClosureEvaluator::compile_if_else(const IfElseNode& if_else) {
+    expression_closure condition = compile_expression(*if_else.condition);
+    vector<statement_closure> if_branch = compile_statements(if_else.if_branch->statements);
+    if (!if_else.else_branch) {
+        return [this, &if_else, condition = std::move(condition), if_branch = std::move(if_branch)]() {
+            if (!runtime_.to_boolean(condition(), if_else.position)) return completion::normal;
+            return run_block(if_branch, *if_else.if_branch);
+        };
+    }
+    vector<statement_closure> else_branch = compile_statements(if_else.else_branch->statements);
+    return [this, &if_else, condition = std::move(condition), if_branch = std::move(if_branch), else_branch = std::move(else_branch)]() {
+        if (runtime_.to_boolean(condition(), if_else.position)) return run_block(if_branch, *if_else.if_branch);
+        return run_block(else_branch, *if_else.else_branch);
+    };
+}
+
+bool ClosureEvaluator::is_literal(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+    case NodeKind::LongNumberLiteral:
+    case NodeKind::DoubleNumberLiteral:
+    case NodeKind::BoolLiteral:
+        return true;
+    default:
+        return false;
+    }
+}
+
+Value ClosureEvaluator::literal(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+        return runtime_.string_literal(static_cast<const StringLiteral&>(expression).value);
+    case NodeKind::LongNumberLiteral:
+        return Value(static_cast<const LongNumberLiteral&>(expression).value);
+    case NodeKind::DoubleNumberLiteral:
+        return Value(static_cast<const DoubleNumberLiteral&>(expression).value);
+    case NodeKind::BoolLiteral:
+        return Value(static_cast<const BoolLiteral&>(expression).value);
+    default:
+        throw runtime_error("Unknown literal");
+    }
+}
+
+// read from the innermost scope's slot, see get_local
+static bool is_local(const ExpressionNode& expression) {
+    if (expression.kind != NodeKind::Variable) return false;
+    auto& variable = static_cast<const VariableNode&>(expression);
+    return variable.depth == 0 && variable.slot != no_slot;
+}
+
+ClosureEvaluator::expression_closure ClosureEvaluator::compile_expression(const ExpressionNode& expression) {
+    if (is_literal(expression)) {
+        return [value = literal(expression)]() { return value; };
+    }
+    switch (expression.kind) {
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        if (is_local(variable)) return [this, &variable]() { return get_local(variable); };
+        return [this, &variable]() { return get_variable(variable); };
+    }
+    case NodeKind::BinaryOp:
+        return compile_binary_op(static_cast<const BinaryOpNode&>(expression));
+
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        expression_closure operand = compile_expression(*unary.operand);
+        return [this, &unary, operand = std::move(operand)]() {
+            return runtime_.unary_op(unary.op, operand(), unary.position);
+        };
+    }
+    case NodeKind::FunctionCall:
+        return compile_call(static_cast<const FunctionCallNode&>(expression));
+
+    default:
+        throw runtime_error("Unknown expression");
+    }
+}
+
+ClosureEvaluator::expression_closure ClosureEvaluator::compile_call(const FunctionCallNode& call) {
+    vector<expression_closure> arguments;
+    for (const auto& argument : call.arguments) {
+        arguments.push_back(compile_expression(*argument));
+    }
+    if (const native_function* native = runtime_.native(call.name)) {
+        return [&call, native, arguments = std::move(arguments)]() {
+            vector<Value> values;
+            values.reserve(arguments.size());
+            for (const auto& argument : arguments) {
+                values.push_back(argument());
+            }
+            return (*native)(values, call.position);
+        };
+    }
+    // the callee is only known at run time
+    return [this, &call, arguments = std::move(arguments)]() {
+        return this->call(call, arguments);
+    };
+}
+
+// picks the closure for the shapes of both operands and for the operator
+ClosureEvaluator::expression_closure ClosureEvaluator::compile_binary_op(const BinaryOpNode& binary) {
+    if (Runtime::is_short_circuit(binary.op)) {
+        // and is decided by a false left operand, or by a true one
+        const bool decided = binary.op == TokenType::LOGICAL_OR;
+        expression_closure left = compile_expression(*binary.left), right = compile_expression(*binary.right);
+        return [this, decided, position = binary.position, left = std::move(left), right = std::move(right)]() {
+            if (runtime_.to_boolean(left(), position) == decided) return Value(decided);
+            return Value(runtime_.to_boolean(right(), position));
+        };
+    }
+    const ExpressionNode& left = *binary.left;
+    if (is_literal(left)) return compile_binary_op(binary, constant_operand{ literal(left) });
+    if (is_local(left)) return compile_binary_op(binary, local_operand{ static_cast<const VariableNode*>(&left) });
+    return compile_binary_op(binary, any_operand{ compile_expression(left) });
+}
+
+template <typename Left>
+ClosureEvaluator::expression_closure ClosureEvaluator::compile_binary_op(const BinaryOpNode& binary, Left left) {
+    const ExpressionNode& right = *binary.right;
+    if (is_literal(right)) return binary_op(binary.op, std::move(left), constant_operand{ literal(right) }, binary.position);
+    if (is_local(right)) return binary_op(binary.op, std::move(left), local_operand{ static_cast<const VariableNode*>(&right) }, binary.position);
+    return binary_op(binary.op, std::move(left), any_operand{ compile_expression(right) }, binary.position);
+}
+
+template <typename Left, typename Right>
+ClosureEvaluator::expression_closure ClosureEvaluator::binary_op(TokenType op, Left left, Right right, uint32_t position) {
+    switch (op) {
+#define SIA_FIXED_OPERATOR(token) \
+        case TokenType::token : return binary_closure(fixed_operator<TokenType::token>(), std::move(left), std::move(right), position);
+        SIA_FIXED_OPERATOR(PLUS)
+        SIA_FIXED_OPERATOR(MINUS)
+        SIA_FIXED_OPERATOR(MULTIPLY)
+        SIA_FIXED_OPERATOR(DIVIDE)
+        SIA_FIXED_OPERATOR(MODULO)
+        SIA_FIXED_OPERATOR(LESS_THAN)
+        SIA_FIXED_OPERATOR(GREATER_THAN)
+        SIA_FIXED_OPERATOR(LESS_EQUAL)
+        SIA_FIXED_OPERATOR(GREATER_EQUAL)
+        SIA_FIXED_OPERATOR(EQUAL)
+        SIA_FIXED_OPERATOR(NOT_EQUAL)
+#undef SIA_FIXED_OPERATOR
+        default: return binary_closure(any_operator{ op }, std::move(left), std::move(right), position);
+    }
+}
+
+template <typename Operator, typename Left, typename Right>
+ClosureEvaluator::expression_closure ClosureEvaluator::binary_closure(Operator op, Left left, Right right, uint32_t position) {
+    return [this, op, left = std::move(left), right = std::move(right), position]() {
+        Value left_value, right_value;
+        // a borrowed left operand would dangle if the right one grew the value stack
+        const Value& left_operand = Right::plain ? left(*this, left_value) : (left_value = left(*this, left_value));
+        const Value& right_operand = right(*this, right_value);
+        return runtime_.binary_op(op(), left_operand, right_operand, position);
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "environment.hpp"
+#include "runtime.hpp"
+#include "token.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// runs programs by first turning every node into a callable specialized for it: operators,
+// literals and variable slots are picked once, when the node is compiled, instead of on every
+// visit. behaves exactly like the Evaluator
+class ClosureEvaluator {
+public:
+    ClosureEvaluator();
+    void evaluate(const ProgramNode& program);
+    void print_stats(ostream& out) const;
+    virtual ~ClosureEvaluator() = default;
+
+private:
+    // how a statement finished, a return stops every enclosing block and loop up to its call.
+    // tail_call: the running function called itself in a return, its parameters hold the arguments
+    enum class completion { normal, returned, tail_call };
+
+    using expression_closure = function<Value()>;
+    using statement_closure = function<completion()>;
+
+    struct compiled_body {
+        const BlockNode* block;
+        vector<statement_closure> statements;
+    };
+
+    struct function_entry {
+        // null while the function isn't defined
+        const FunctionDefNode* definition = nullptr;
+        // null until the function is first called
+        const compiled_body* body = nullptr;
+    };
+
+    // the operator of a binary operation, fixed ones let the compiler fold the dispatch of binary_op
+    template <TokenType op>
+    struct fixed_operator {
+        TokenType operator()() const { return op; }
+    };
+    struct any_operator {
+        TokenType op;
+        TokenType operator()() const { return op; }
+    };
+
+    // operands of a binary operator. each gives a reference to its value, temporary holds it
+    // when it has to be computed
+    struct constant_operand {
+        static constexpr bool plain = true;
+        Value value;
+        const Value& operator()(ClosureEvaluator&, Value&) const { return value; }
+    };
+    struct local_operand {
+        static constexpr bool plain = true;
+        const VariableNode* variable;
+        const Value& operator()(ClosureEvaluator& self, Value&) const { return self.get_local(*variable); }
+    };
+    struct any_operand {
+        static constexpr bool plain = false;
+        expression_closure closure;
+        const Value& operator()(ClosureEvaluator&, Value& temporary) const { return temporary = closure(); }
+    };
+
+    Runtime runtime_;
+    Environment environment_;
+    // value of the return statement that completed last
+    Value return_value_;
+    // right operands of the appends being evaluated, nested appends stack theirs on top
+    vector<Value> append_operands_;
+    size_t calls_;
+    // calls that reused their caller's frame, and how deep calls got counting those frames too
+    size_t tail_calls_;
+    size_t depth_, peak_depth_;
+    // null outside of any call
+    const FunctionDefNode* running_;
+    // arguments of a tail call, evaluated before any parameter is overwritten
+    vector<Value> tail_arguments_;
+    // indexed by symbol
+    vector<function_entry> functions_;
+    // compiled bodies, by body so a redefinition of the same function reuses them
+    unordered_map<const BlockNode*, compiled_body> bodies_;
+
+    const Value& get_variable(const VariableNode& variable);
+    const Value& get_local(const VariableNode& variable);
+    completion run_block(const vector<statement_closure>& statements, const BlockNode& block);
+    Value call(const FunctionCallNode& call, const vector<expression_closure>& arguments);
+    bool tail_call(const FunctionCallNode& call, const vector<expression_closure>& arguments);
+
+    vector<statement_closure> compile_statements(const ArenaList<StatementNode*>& statements);
+    statement_closure compile_block(const BlockNode& block, bool new_scope);
+    statement_closure compile_statement(const StatementNode& statement);
+    statement_closure compile_assignment(const AssignmentNode& assignment);
+    statement_closure compile_loop(const LoopNode& loop);
+    statement_closure compile_if_else(const IfElseNode& if_else);
+
+    static bool is_literal(const ExpressionNode& expression);
+    Value literal(const ExpressionNode& expression);
+    expression_closure compile_expression(const ExpressionNode& expression);
+    expression_closure compile_call(const FunctionCallNode& call);
+    expression_closure compile_binary_op(const BinaryOpNode& binary);
+    template <typename Left>
+    expression_closure compile_binary_op(const BinaryOpNode& binary, Left left);
+    template <typename Left, typename Right>
+    expression_closure binary_op(TokenType op, Left left, Right right, uint32_t position);
+    template <typename Operator, typename Left, typename Right>
+    expression_closure binary_closure(Operator op, Left left, Right right, uint32_t position);
+};
@@ -0,0 +1,295 @@
+#include <algorithm>
+
+#include "compiler.hpp"
+
+using namespace std;
+
+Compiler::Compiler(Bytecode& bytecode, Runtime& runtime)
+    : bytecode_(bytecode), runtime_(runtime), chunk_(nullptr), depth_(0), top_level_(false), block_nesting_(0) {}
+
+void Compiler::compile_program(const ProgramNode& program, Chunk& chunk) {
+    begin(chunk, true);
+    compile_statements(program.statements);
+    emit(OpCode::RETURN_NULL);
+}
+
+void Compiler::compile_function(const BlockNode& body, Chunk& chunk) {
+    begin(chunk, false);
+    chunk.body = &body;
+    compile_statements(body.statements);
+    emit(OpCode::RETURN_NULL);
+}
+
+void Compiler::begin(Chunk& chunk, bool top_level) {
+    chunk_ = &chunk;
+    depth_ = 0;
+    top_level_ = top_level;
+    block_nesting_ = 0;
+}
+
+size_t Compiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c) {
+    switch (op) {
+    case OpCode::CONSTANT:
+    case OpCode::LOAD_LOCAL:
+    case OpCode::LOAD_VARIABLE:
+    case OpCode::CALL:
+    case OpCode::TAIL_CALL:
+        depth_++;
+        break;
+    case OpCode::STORE_LOCAL:
+    case OpCode::POP:
+    case OpCode::ADD:
+    case OpCode::SUBTRACT:
+    case OpCode::MULTIPLY:
+    case OpCode::DIVIDE:
+    case OpCode::MODULO:
+    case OpCode::LESS:
+    case OpCode::GREATER:
+    case OpCode::LESS_EQUAL:
+    case OpCode::GREATER_EQUAL:
+    case OpCode::EQUAL:
+    case OpCode::NOT_EQUAL:
+    case OpCode::BINARY:
+    case OpCode::JUMP_IF_FALSE:
+    case OpCode::SHORT_CIRCUIT:
+    case OpCode::ARGUMENT:
+    case OpCode::RETURN:
+        depth_--;
+        break;
+    case OpCode::APPEND_LOCAL:
+        depth_ -= b;
+        break;
+    case OpCode::CALL_NATIVE:
+        depth_ = depth_ - b + 1;
+        break;
+    default:
+        break;
+    }
+    chunk_->max_stack = max(chunk_->max_stack, depth_);
+    chunk_->code.push_back({ op, a, b, c });
+    return chunk_->code.size() - 1;
+}
+
+// points a forward jump at the next instruction
+void Compiler::patch(size_t instruction) {
+    Instruction& jump = chunk_->code[instruction];
+    if (jump.op == OpCode::JUMP_UNLESS_LOCAL_STRING) {
+        jump.b = here();
+    } else {
+        jump.a = here();
+    }
+}
+
+uint32_t Compiler::node(const ASTNode& node) {
+    bytecode_.nodes.push_back(&node);
+    return bytecode_.nodes.size() - 1;
+}
+
+uint32_t Compiler::constant(Value value) {
+    bytecode_.constants.push_back(std::move(value));
+    return bytecode_.constants.size() - 1;
+}
+
+void Compiler::compile_statements(const ArenaList<StatementNode*>& statements) {
+    for (const auto& statement : statements) {
+        compile_statement(*statement);
+    }
+}
+
+// body of a bare block, a loop or an if
+void Compiler::compile_block(const BlockNode& block) {
+    const bool outermost = top_level_ && block_nesting_ == 0;
+    const uint32_t begin = here();
+    block_nesting_++;
+    compile_statements(block.statements);
+    block_nesting_--;
+    if (outermost) chunk_->blocks.push_back({ begin, here(), block.position });
+}
+
+void Compiler::compile_statement(const StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block: {
+        auto& block = static_cast<const BlockNode&>(statement);
+        emit(OpCode::ENTER_SCOPE, node(block));
+        compile_block(block);
+        emit(OpCode::EXIT_SCOPE);
+        break;
+    }
+    case NodeKind::Assignment:
+        compile_assignment(static_cast<const AssignmentNode&>(statement));
+        break;
+
+    case NodeKind::Loop:
+        compile_loop(static_cast<const LoopNode&>(statement));
+        break;
+
+    case NodeKind::IfElse:
+        compile_if_else(static_cast<const IfElseNode&>(statement));
+        break;
+
+    case NodeKind::FunctionDef:
+        emit(OpCode::DEFINE, node(statement));
+        break;
+
+    case NodeKind::ExpressionStatement:
+        compile_expression(*static_cast<const ExpressionStatementNode&>(statement).expression);
+        emit(OpCode::POP);
+        break;
+
+    case NodeKind::Return: {
+        auto& my_return = static_cast<const ReturnNode&>(statement);
+        if (my_return.tail_call && !runtime_.native(static_cast<const FunctionCallNode&>(*my_return.expression).name)) {
+            compile_call(static_cast<const FunctionCallNode&>(*my_return.expression), true);
+            emit(OpCode::RETURN);
+        } else if (my_return.expression) {
+            compile_expression(*my_return.expression);
+            emit(OpCode::RETURN);
+        } else {
+            emit(OpCode::RETURN_NULL);
+        }
+        break;
+    }
+    default:
+        throw runtime_error("Unknown statement");
+    }
+}
+
+void Compiler::compile_assignment(const AssignmentNode& assignment) {
+    if (!Runtime::is_append(assignment)) {
+        compile_expression(*assignment.expression);
+        emit(OpCode::STORE_LOCAL, assignment.slot);
+        return;
+    }
+    // same as the tree walker: appended in place while the variable holds a string
+    size_t not_string = emit(OpCode::JUMP_UNLESS_LOCAL_STRING, assignment.slot);
+    const uint32_t depth = depth_;
+    compile_append_operands(*assignment.expression);
+    emit(OpCode::APPEND_LOCAL, assignment.slot, depth_ - depth, assignment.position);
+    size_t done = emit(OpCode::JUMP);
+    patch(not_string);
+    compile_expression(*assignment.expression);
+    emit(OpCode::STORE_LOCAL, assignment.slot);
+    patch(done);
+}
+
+void Compiler::compile_append_operands(const ExpressionNode& expression) {
+    if (expression.kind != NodeKind::BinaryOp) return;
+    auto& binary = static_cast<const BinaryOpNode&>(expression);
+    compile_append_operands(*binary.left);
+    compile_expression(*binary.right);
+}
+
+void Compiler::compile_loop(const LoopNode& loop) {
+    compile_expression(*loop.condition);
+    emit(OpCode::LOOP_COUNT, 0, 0, loop.position);
+    const uint32_t start = here();
+    size_t exit = emit(OpCode::LOOP_NEXT);
+    compile_block(*loop.body);
+    emit(OpCode::JUMP, start);
+    patch(exit);
+    // the count is popped on the way out
+    depth_--;
+}
+
+void Compiler::compile_if_else(const IfElseNode& if_else) {
+    compile_expression(*if_else.condition);
+    size_t skip_if = emit(OpCode::JUMP_IF_FALSE, 0, 0, if_else.position);
+    compile_block(*if_else.if_branch);
+    if (if_else.else_branch) {
+        size_t skip_else = emit(OpCode::JUMP);
+        patch(skip_if);
+        compile_block(*if_else.else_branch);
+        patch(skip_else);
+    } else {
+        patch(skip_if);
+    }
+}
+
+void Compiler::compile_expression(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+        emit(OpCode::CONSTANT, constant(runtime_.string_literal(static_cast<const StringLiteral&>(expression).value)));
+        break;
+
+    case NodeKind::LongNumberLiteral:
+        emit(OpCode::CONSTANT, constant(Value(static_cast<const LongNumberLiteral&>(expression).value)));
+        break;
+
+    case NodeKind::DoubleNumberLiteral:
+        emit(OpCode::CONSTANT, constant(Value(static_cast<const DoubleNumberLiteral&>(expression).value)));
+        break;
+
+    case NodeKind::BoolLiteral:
+        emit(OpCode::CONSTANT, constant(Value(static_cast<const BoolLiteral&>(expression).value)));
+        break;
+
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        if (variable.depth == 0 && variable.slot != no_slot) {
+            emit(OpCode::LOAD_LOCAL, variable.slot, node(variable));
+        } else {
+            emit(OpCode::LOAD_VARIABLE, 0, node(variable));
+        }
+        break;
+    }
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        compile_expression(*binary.left);
+        if (Runtime::is_short_circuit(binary.op)) {
+            // the stack only holds the left operand's truth when the jump is taken
+            size_t done = emit(OpCode::SHORT_CIRCUIT, 0, binary.op == TokenType::LOGICAL_OR, binary.position);
+            compile_expression(*binary.right);
+            emit(OpCode::TRUTH, 0, 0, binary.position);
+            patch(done);
+            break;
+        }
+        compile_expression(*binary.right);
+        switch (binary.op) {
+            case TokenType::PLUS : emit(OpCode::ADD, 0, 0, binary.position); break;
+            case TokenType::MINUS : emit(OpCode::SUBTRACT, 0, 0, binary.position); break;
+            case TokenType::MULTIPLY : emit(OpCode::MULTIPLY, 0, 0, binary.position); break;
+            case TokenType::DIVIDE : emit(OpCode::DIVIDE, 0, 0, binary.position); break;
+            case TokenType::MODULO : emit(OpCode::MODULO, 0, 0, binary.position); break;
+            case TokenType::LESS_THAN : emit(OpCode::LESS, 0, 0, binary.position); break;
+            case TokenType::GREATER_THAN : emit(OpCode::GREATER, 0, 0, binary.position); break;
+            case TokenType::LESS_EQUAL : emit(OpCode::LESS_EQUAL, 0, 0, binary.position); break;
+            case TokenType::GREATER_EQUAL : emit(OpCode::GREATER_EQUAL, 0, 0, binary.position); break;
+            case TokenType::EQUAL : emit(OpCode::EQUAL, 0, 0, binary.position); break;
+            case TokenType::NOT_EQUAL : emit(OpCode::NOT_EQUAL, 0, 0, binary.position); break;
+            default: emit(OpCode::BINARY, binary.op, 0, binary.position); break;
+        }
+        break;
+    }
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        compile_expression(*unary.operand);
+        emit(OpCode::UNARY, unary.op, 0, unary.position);
+        break;
+    }
+    case NodeKind::FunctionCall:
+        compile_call(static_cast<const FunctionCallNode&>(expression));
+        break;
+
+    default:
+        throw runtime_error("Unknown expression");
+    }
+}
+
+void Compiler::compile_call(const FunctionCallNode& call, bool tail) {
+    if (const native_function* native = runtime_.native(call.name)) {
+        for (const auto& argument : call.arguments) {
+            compile_expression(*argument);
+        }
+        bytecode_.natives.push_back(native);
+        emit(OpCode::CALL_NATIVE, bytecode_.natives.size() - 1, call.arguments.size(), call.position);
+        return;
+    }
+    // the callee is only known at run time, its scope is reserved before the arguments are
+    // evaluated in the caller's, each one then goes straight into its parameter
+    emit(OpCode::PREPARE_CALL, node(call), 0, call.position);
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        compile_expression(*call.arguments[i]);
+        emit(OpCode::ARGUMENT, i);
+    }
+    emit(tail ? OpCode::TAIL_CALL : OpCode::CALL);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "runtime.hpp"
+
+using namespace std;
+
+// lowers resolved trees to bytecode. function bodies are compiled on their own,
+// when they are first called, since they may only be parsed then
+class Compiler {
+public:
+    Compiler(Bytecode& bytecode, Runtime& runtime);
+    void compile_program(const ProgramNode& program, Chunk& chunk);
+    void compile_function(const BlockNode& body, Chunk& chunk);
+    virtual ~Compiler() = default;
+
+private:
+    Bytecode& bytecode_;
+    Runtime& runtime_;
+    Chunk* chunk_;
+    // operand stack depth at the current instruction
+    uint32_t depth_;
+    bool top_level_;
+    uint32_t block_nesting_;
+
+    void begin(Chunk& chunk, bool top_level);
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0);
+    void patch(size_t instruction);
+    uint32_t here() const { return chunk_->code.size(); }
+    uint32_t node(const ASTNode& node);
+    uint32_t constant(Value value);
+
+    void compile_statements(const ArenaList<StatementNode*>& statements);
+    void compile_block(const BlockNode& block);
+    void compile_statement(const StatementNode& statement);
+    void compile_assignment(const AssignmentNode& assignment);
+    void compile_append_operands(const ExpressionNode& expression);
+    void compile_loop(const LoopNode& loop);
+    void compile_if_else(const IfElseNode& if_else);
+    void compile_expression(const ExpressionNode& expression);
+    // a tail call is followed by the return it is in
+    void compile_call(const FunctionCallNode& call, bool tail = false);
+};
@@ -0,0 +1,186 @@
+#include <charconv>
+#include <string>
+
+#include "dump.hpp"
+
+using namespace std;
+
+namespace {
+
+const char* operator_text(TokenType op) {
+    switch (op) {
+        case TokenType::MULTIPLY : return "*";
+        case TokenType::DIVIDE : return "/";
+        case TokenType::MODULO : return "%";
+        case TokenType::PLUS : return "+";
+        case TokenType::MINUS : return "-";
+        case TokenType::LESS_THAN : return "<";
+        case TokenType::GREATER_THAN : return ">";
+        case TokenType::LESS_EQUAL : return "<=";
+        case TokenType::GREATER_EQUAL : return ">=";
+        case TokenType::EQUAL : return "==";
+        case TokenType::NOT_EQUAL : return "!=";
+        case TokenType::LOGICAL_AND : return "and";
+        case TokenType::LOGICAL_OR : return "or";
+        default: return "?";
+    }
+}
+
+class Dumper {
+public:
+    Dumper(const ProgramNode& program, ostream& out) : program_(program), out_(out) {}
+
+    void statements(const ArenaList<StatementNode*>& statements, int depth) {
+        for (const auto& statement : statements) {
+            this->statement(*statement, depth);
+        }
+    }
+
+private:
+    const ProgramNode& program_;
+    ostream& out_;
+
+    ostream& line(int depth) {
+        return out_ << string(2 * depth, ' ');
+    }
+
+    string_view name(Symbol symbol) const { return program_.symbols.name(symbol); }
+
+    void block(const BlockNode& block, const char* label, int depth) {
+        line(depth) << label;
+        if (block.layout) out_ << " (" << block.layout->names.size() << " slots)";
+        out_ << "\n";
+        statements(block.statements, depth + 1);
+    }
+
+    void statement(const StatementNode& statement, int depth) {
+        switch (statement.kind) {
+        case NodeKind::Block:
+            block(static_cast<const BlockNode&>(statement), "block", depth);
+            break;
+
+        case NodeKind::Assignment: {
+            auto& assignment = static_cast<const AssignmentNode&>(statement);
+            line(depth) << "assign " << name(assignment.identifier);
+            if (assignment.slot != no_slot) out_ << " (slot " << assignment.slot << ")";
+            out_ << "\n";
+            expression(*assignment.expression, depth + 1);
+            break;
+        }
+        case NodeKind::Loop: {
+            auto& loop = static_cast<const LoopNode&>(statement);
+            line(depth) << "loop\n";
+            expression(*loop.condition, depth + 1);
+            block(*loop.body, "body", depth + 1);
+            break;
+        }
+        case NodeKind::IfElse: {
+            auto& if_else = static_cast<const IfElseNode&>(statement);
+            line(depth) << "if\n";
+            expression(*if_else.condition, depth + 1);
+            block(*if_else.if_branch, "then", depth + 1);
+            if (if_else.else_branch) block(*if_else.else_branch, "else", depth + 1);
+            break;
+        }
+        case NodeKind::FunctionDef: {
+            auto& function = static_cast<const FunctionDefNode&>(statement);
+            line(depth) << "function " << name(function.name) << "(";
+            for (size_t i = 0; i < function.parameters.size(); ++i) {
+                out_ << (i ? ", " : "") << name(function.parameters[i]);
+            }
+            out_ << ")";
+            if (!function.body) {
+                out_ << " (not parsed yet)\n";
+                break;
+            }
+            out_ << "\n";
+            block(*function.body, "body", depth + 1);
+            break;
+        }
+        case NodeKind::ExpressionStatement:
+            line(depth) << "expression\n";
+            expression(*static_cast<const ExpressionStatementNode&>(statement).expression, depth + 1);
+            break;
+
+        case NodeKind::Return: {
+            auto& my_return = static_cast<const ReturnNode&>(statement);
+            line(depth) << (my_return.tail_call ? "return, tail call\n" : "return\n");
+            if (my_return.expression) expression(*my_return.expression, depth + 1);
+            break;
+        }
+        default:
+            line(depth) << "unknown statement\n";
+            break;
+        }
+    }
+
+    void expression(const ExpressionNode& expression, int depth) {
+        switch (expression.kind) {
+        case NodeKind::StringLiteral:
+            line(depth) << "string \"" << name(static_cast<const StringLiteral&>(expression).value) << "\"\n";
+            break;
+
+        case NodeKind::LongNumberLiteral:
+            line(depth) << "long " << static_cast<const LongNumberLiteral&>(expression).value << "\n";
+            break;
+
+        case NodeKind::DoubleNumberLiteral: {
+            // the shortest text that reads back as the same double
+            char buffer[64];
+            string text(buffer, to_chars(buffer, buffer + sizeof(buffer), static_cast<const DoubleNumberLiteral&>(expression).value).ptr);
+            line(depth) << "double " << text << "\n";
+            break;
+        }
+        case NodeKind::BoolLiteral:
+            line(depth) << "bool " << (static_cast<const BoolLiteral&>(expression).value ? "true" : "false") << "\n";
+            break;
+
+        case NodeKind::Variable: {
+            auto& variable = static_cast<const VariableNode&>(expression);
+            line(depth) << "variable " << name(variable.identifier);
+            if (variable.slot == no_slot) {
+                out_ << " (by name, " << variable.depth << " scopes up)";
+            } else if (variable.depth == 0) {
+                out_ << " (slot " << variable.slot << ")";
+            } else {
+                out_ << " (" << variable.depth << " scopes up, slot " << variable.slot << ")";
+            }
+            out_ << "\n";
+            break;
+        }
+        case NodeKind::BinaryOp: {
+            auto& binary = static_cast<const BinaryOpNode&>(expression);
+            line(depth) << "binary " << operator_text(binary.op) << "\n";
+            this->expression(*binary.left, depth + 1);
+            this->expression(*binary.right, depth + 1);
+            break;
+        }
+        case NodeKind::UnaryOp: {
+            auto& unary = static_cast<const UnaryOpNode&>(expression);
+            line(depth) << "unary " << operator_text(unary.op) << "\n";
+            this->expression(*unary.operand, depth + 1);
+            break;
+        }
+        case NodeKind::FunctionCall: {
+            auto& call = static_cast<const FunctionCallNode&>(expression);
+            line(depth) << "call " << name(call.name) << "\n";
+            for (const auto& argument : call.arguments) {
+                this->expression(*argument, depth + 1);
+            }
+            break;
+        }
+        default:
+            line(depth) << "unknown expression\n";
+            break;
+        }
+    }
+};
+
+}
+
+void dump_ast(const ProgramNode& program, ostream& out) {
+    out << "program";
+    if (program.layout) out << " (" << program.layout->names.size() << " slots)";
+    out << "\n";
+    Dumper(program, out).statements(program.statements, 1);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <ostream>
+
+#include "ast.hpp"
+
+using namespace std;
+
+// one node per line, children indented below their parent, with the slots the resolver picked
+void dump_ast(const ProgramNode& program, ostream& out);
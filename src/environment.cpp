@@ -0,0 +1,56 @@
+#include <algorithm>
+
+#include "environment.hpp"
+
+using namespace std;
+
+Environment::Environment() {
+    values_.reserve(256);
+    scopes_.reserve(64);
+}
+
+size_t Environment::reserve(const ScopeLayout& layout) {
+    const size_t base = values_.size();
+    const size_t size = base + layout.names.size();
+    if (size > values_.capacity()) {
+        values_.reserve(max(size, values_.capacity() * 2));
+        stats_.growths++;
+    }
+    values_.resize(size, Value::unset());
+    stats_.peak_slots = max(stats_.peak_slots, size);
+    return base;
+}
+
+void Environment::enter(const ScopeLayout& layout, size_t base) {
+    if (scopes_.size() == scopes_.capacity()) stats_.growths++;
+    scopes_.push_back({ &layout, base });
+    stats_.scopes++;
+}
+
+void Environment::pop() {
+    if (scopes_.empty()) return;
+    values_.resize(scopes_.back().base);
+    scopes_.pop_back();
+}
+
+void Environment::pop_to(size_t depth) {
+    if (depth >= scopes_.size()) return;
+    values_.resize(scopes_[depth].base);
+    scopes_.resize(depth);
+}
+
+const Value* Environment::find(uint32_t depth, uint32_t slot, Symbol identifier) const {
+    // the scopes nearer than depth never assign the name
+    size_t index = scopes_.size() - depth;
+    if (slot != no_slot) {
+        const Value& value = values_[scopes_[--index].base + slot];
+        if (!value.is_unset()) return &value;
+    }
+    // not assigned yet, or not assigned by the enclosing function: the callers' scopes are searched by name
+    while (index-- > 0) {
+        const auto& scope = scopes_[index];
+        uint32_t found = scope.layout->find(identifier);
+        if (found != no_slot && !values_[scope.base + found].is_unset()) return &values_[scope.base + found];
+    }
+    return nullptr;
+}
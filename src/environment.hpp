@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ast.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// the scopes of a running program, laid out one after the other on a single value stack.
+// a scope's slots follow its resolved layout and stay empty until they are first assigned.
+// the stack only grows when a program nests deeper than it ever did, calls reuse its storage
+class Environment {
+public:
+    struct stats {
+        size_t scopes = 0;
+        // times the value stack or the scope list had to be reallocated
+        size_t growths = 0;
+        size_t peak_slots = 0;
+    };
+
+    Environment();
+    virtual ~Environment() = default;
+
+    // slots for a scope that isn't entered yet, so a call can fill its parameters
+    // while its arguments are still evaluated in the caller's scope
+    size_t reserve(const ScopeLayout& layout);
+    void enter(const ScopeLayout& layout, size_t base);
+    void push(const ScopeLayout& layout) { enter(layout, reserve(layout)); }
+    // drops the slots reserved for a call that didn't need its scope
+    void release(size_t base) { values_.resize(base); }
+    void pop();
+    // number of scopes entered, a return leaves every scope its call entered with pop_to
+    size_t depth() const { return scopes_.size(); }
+    void pop_to(size_t depth);
+
+    // null when the variable isn't assigned in any scope
+    const Value* find(const VariableNode& variable) const { return find(variable.depth, variable.slot, variable.identifier); }
+    const Value* find(uint32_t depth, uint32_t slot, Symbol identifier) const;
+    void set(uint32_t slot, Value value) { local(slot) = std::move(value); }
+    // slot of the innermost scope
+    Value& local(uint32_t slot) { return values_[scopes_.back().base + slot]; }
+    // slots of the innermost scope, until the next scope is reserved, entered or left
+    Value* locals() { return values_.data() + scopes_.back().base; }
+    Value& slot(size_t base, uint32_t slot) { return values_[base + slot]; }
+    Value* slots(size_t base) { return values_.data() + base; }
+
+    const stats& statistics() const { return stats_; }
+
+private:
+    struct scope {
+        const ScopeLayout* layout;
+        size_t base;
+    };
+
+    vector<Value> values_;
+    vector<scope> scopes_;
+    stats stats_;
+};
@@ -1,347 +1,449 @@
-#include <cmath>
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
 #include <string>
-#include <variant>
+#include <type_traits>
 #include <vector>
 
 #include "ast.hpp"
 #include "token.hpp"
 #include "evaluator.hpp"
+#include "parser.hpp"
 
 
 using namespace std;
 
-Evaluator::Evaluator() {
-    push_scope();
+namespace {
 
-    // [] -> captures variables to use inside the lambda function
-    native_functions_["print"] = [this](const vector<my_variant>& arguments, unsigned int line, unsigned int column) {
-        string out;
-        for (const auto& argument : arguments) {
-            out += this->variant_to_string(argument, line, column) + " ";
-        }
-        if (!out.empty()) out.pop_back();
-        cout << out << endl;
+// a node is rewritten to the kernel of its operand types after seeing them this many times in a
+// row, and stays generic once it deoptimized max_deoptimizations times
+constexpr uint8_t quicken_threshold = 8;
+constexpr uint8_t max_deoptimizations = 4;
 
-        return monostate();
-    };
+// BinaryFeedback::state
+constexpr uint8_t observing = 0;
+constexpr uint8_t generic = 1;
+constexpr uint8_t specialized = 2;
 
-    native_functions_["pow"] = [this](const vector<my_variant>& arguments, unsigned int line, unsigned int column) {
-        if (arguments.size() != 2) {
-            throw runtime_error(error_message("pow funciton requires exactly 2 arguments: base and exponent", line, column));
+// the arithmetic and comparisons of two longs or two doubles, inlined where the kernel would be an
+// indirect call. false leaves anything else, division included, to the kernels
+template <typename T>
+inline bool same_type_op(TokenType op, T a, T b, Value& result) {
+    switch (op) {
+        case TokenType::PLUS : {
+            if constexpr (is_same_v<T, long>) {
+                long sum;
+                if (__builtin_add_overflow(a, b, &sum)) return false;
+                result = Value(sum);
+            } else {
+                result = Value(a + b);
+            }
+            return true;
         }
+        case TokenType::MINUS : {
+            if constexpr (is_same_v<T, long>) {
+                long difference;
+                if (__builtin_sub_overflow(a, b, &difference)) return false;
+                result = Value(difference);
+            } else {
+                result = Value(a - b);
+            }
+            return true;
+        }
+        case TokenType::MULTIPLY : {
+            if constexpr (is_same_v<T, long>) {
+                long product;
+                if (__builtin_mul_overflow(a, b, &product)) return false;
+                result = Value(product);
+            } else {
+                result = Value(a * b);
+            }
+            return true;
+        }
+        case TokenType::LESS_THAN : result = Value(a < b); return true;
+        case TokenType::GREATER_THAN : result = Value(a > b); return true;
+        case TokenType::LESS_EQUAL : result = Value(a <= b); return true;
+        case TokenType::GREATER_EQUAL : result = Value(a >= b); return true;
+        case TokenType::EQUAL : result = Value(a == b); return true;
+        case TokenType::NOT_EQUAL : result = Value(a != b); return true;
+        default: return false;
+    }
+}
 
-        double base = to_double(arguments[0], line, column);
-        double exponent = to_double(arguments[1], line, column);
-
-        return pow(base, exponent);
-    };
 }
 
+Evaluator::Evaluator(bool jit, size_t memo_limit)
+    : calls_(0), tail_calls_(0), depth_(0), peak_depth_(0), reused_frames_(0), running_(nullptr), jit_(jit ? make_unique<Jit>(runtime_) : nullptr),
+      memo_(memo_limit ? make_unique<MemoCache>(memo_limit) : nullptr) {}
+
 Evaluator::~Evaluator() {
     pop_scope();
 }
 
 void Evaluator::evaluate(const ProgramNode& program) {
+    runtime_.attach(program);
+    push_scope(*program.layout);
+
     for (const auto& statement : program.statements) {
-        evaluate_statement(*statement);
+        // a return outside of any function ends the program
+        if (evaluate_statement(*statement) == completion::returned) break;
     }
 }
 
-void Evaluator::evaluate_block(const BlockNode& block, bool new_scope) {
-    if (new_scope) push_scope();
+Evaluator::completion Evaluator::evaluate_block(const BlockNode& block, bool new_scope) {
+    if (new_scope) push_scope(*block.layout);
+    completion result = completion::normal;
     try {
         for (const auto& statement : block.statements) {
-            evaluate_statement(*statement);
+            result = evaluate_statement(*statement);
+            if (result != completion::normal) break;
         }
-    } catch (const return_exception& my_return) {
+    } catch (const syntax_error& e) {
         if (new_scope) pop_scope();
-        // throwing the exception that was caught
         throw;
     } catch (const runtime_error& e) {
         pop_scope();
-        throw runtime_error(error_message("Error inside block", block.line, block.column));
+        throw runtime_error(runtime_.error_message("Error inside block", block.position));
     }
     if (new_scope) pop_scope();
+    return result;
 }
 
-void Evaluator::evaluate_statement(const StatementNode& statement) {
-    // returns either a valid or null pointer
-    if (auto block = dynamic_cast<const BlockNode*>(&statement)) {
-        evaluate_block(*block, true);
-
-    } else if (auto assignment = dynamic_cast<const AssignmentNode*>(&statement)) {
-        my_variant value = evaluate_expression(*assignment->expression);
-        set_variable(assignment->identifier, value);
-
-    } else if (auto loop = dynamic_cast<const LoopNode*>(&statement)) {
-        evaluate_loop(*loop);
-
-    } else if (auto if_else = dynamic_cast<const IfElseNode*>(&statement)) {
-        evaluate_if_else(*if_else);
+Evaluator::completion Evaluator::evaluate_statement(const StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block:
+        return evaluate_block(static_cast<const BlockNode&>(statement), true);
 
-    } else if (auto function_def = dynamic_cast<const FunctionDefNode*>(&statement)) {
-        functions_[function_def->name] = { function_def->parameters, function_def->body.get() };
-
-    } else if (auto expression_statement = dynamic_cast<const ExpressionStatementNode*>(&statement)) {
-        evaluate_expression_statment(*expression_statement);
+    case NodeKind::Assignment: {
+        auto& assignment = static_cast<const AssignmentNode&>(statement);
+        if (Runtime::is_append(assignment) && append_in_place(assignment)) break;
+        set_variable(assignment.slot, evaluate_expression(*assignment.expression));
+        break;
+    }
+    case NodeKind::Loop:
+        return evaluate_loop(static_cast<const LoopNode&>(statement));
 
-    } else if (auto my_return = dynamic_cast<const ReturnNode*>(&statement)) {
-        my_variant value = my_return->expression ? evaluate_expression(*my_return->expression) : my_variant(monostate());
-        throw return_exception(value);
+    case NodeKind::IfElse:
+        return evaluate_if_else(static_cast<const IfElseNode&>(statement));
 
-    } else {
+    case NodeKind::FunctionDef: {
+        auto& function_def = static_cast<const FunctionDefNode&>(statement);
+        functions_[function_def.name] = { function_def.parameters, function_def.body, &function_def };
+        break;
+    }
+    case NodeKind::ExpressionStatement:
+        evaluate_expression_statment(static_cast<const ExpressionStatementNode&>(statement));
+        break;
+
+    case NodeKind::Return: {
+        auto& my_return = static_cast<const ReturnNode&>(statement);
+        if (my_return.tail_call && tail_call(static_cast<const FunctionCallNode&>(*my_return.expression))) return completion::tail_call;
+        return_value_ = my_return.expression ? evaluate_expression(*my_return.expression) : Value();
+        return completion::returned;
+    }
+    default:
         throw runtime_error("Unknown statement");
     }
+    return completion::normal;
 }
 
 void Evaluator::evaluate_expression_statment(const ExpressionStatementNode& expression_statement) {
     evaluate_expression(*expression_statement.expression);
 }
 
-my_variant Evaluator::evaluate_function_call(const FunctionCallNode& call) {
-    auto native_it = native_functions_.find(call.name);
-    if (native_it != native_functions_.end()) {
-        vector<my_variant> arguments;
+Value Evaluator::evaluate_function_call(const FunctionCallNode& call) {
+    if (const native_function* native = runtime_.native(call.name)) {
+        vector<Value> arguments;
         for (const auto& argument  : call.arguments) {
             arguments.push_back(evaluate_expression(*argument));
         }
 
-        return native_it->second(arguments, call.line, call.column);
+        return (*native)(arguments, call.position);
     }
 
     auto it = functions_.find(call.name);
     if (it == functions_.end()) {
-        throw runtime_error(error_message("Undefined function : " + call.name, call.line, call.column));
+        throw runtime_error(runtime_.error_message("Undefined function : " + string(runtime_.program().symbols.name(call.name)), call.position));
     }
 
-    const auto& function = it->second;
+    auto& function = it->second;
     if (call.arguments.size() != function.parameters.size()) {
-        throw runtime_error(error_message("Argument count mismatch", call.line, call.column));
+        throw runtime_error(runtime_.error_message("Argument count mismatch", call.position));
     }
-
-    push_scope();
-
-    try {
-        vector<my_variant> evaluated_args;
-        for (const auto& arg : call.arguments) {
-            evaluated_args.push_back(evaluate_expression(*arg));
+    if (!function.body) function.body = runtime_.parse_body(*function.definition);
+
+    calls_++;
+    // arguments are evaluated in the caller's scope, straight into the slots of the callee's
+    const BlockNode& body = *function.body;
+    const ScopeLayout& layout = *body.layout;
+    size_t base = environment_.reserve(layout);
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        Value value = evaluate_expression(*call.arguments[i]);
+        environment_.slot(base, layout.parameters[i]) = std::move(value);
+    }
+    // the key is taken before the body runs, it can assign its parameters
+    MemoCache::key key;
+    const bool memoized = memo_ && function.definition->pure && memo_->make_key(*function.definition, environment_.slots(base), layout.parameters, key);
+    if (memoized) {
+        if (const Value* cached = memo_->find(key)) {
+            environment_.release(base);
+            return *cached;
         }
-
-        for (size_t i = 0; i < evaluated_args.size(); ++i) {
-            set_variable(function.parameters[i], evaluated_args[i]);
+    }
+    if (jit_ && jit_->hot(*function.definition)) {
+        Value result;
+        if (jit_->call(*function.definition, body, environment_.slots(base), result, depth_ - reused_frames_)) {
+            environment_.release(base);
+            if (memoized) memo_->insert(key, result);
+            return result;
         }
-
-        evaluate_block(*function.body, false);
-    } catch (const return_exception& my_return) {
-        pop_scope();
-        return my_return.value;
     }
-
+    environment_.enter(layout, base);
+
+    const FunctionDefNode* caller = running_;
+    running_ = function.definition;
+    size_t frames = 1;
+    peak_depth_ = max(peak_depth_, ++depth_);
+    completion result = evaluate_block(body, false);
+    while (result == completion::tail_call) {
+        frames++;
+        reused_frames_++;
+        peak_depth_ = max(peak_depth_, ++depth_);
+        result = evaluate_block(body, false);
+    }
+    depth_ -= frames;
+    reused_frames_ -= frames - 1;
+    running_ = caller;
     pop_scope();
-    return monostate();
+    Value returned = result == completion::returned ? std::move(return_value_) : Value();
+    if (memoized) memo_->insert(key, returned);
+    return returned;
+}
+
+// a function returning a call of itself is a loop: the arguments are evaluated in the running
+// frame, then overwrite its parameters. the other variables keep their values, which is what the
+// callee would find looking them up while its own are unset, the caller's frame being the
+// nearest. false when the call has to run in a frame of its own
+bool Evaluator::tail_call(const FunctionCallNode& call) {
+    if (runtime_.native(call.name)) return false;
+    auto it = functions_.find(call.name);
+    if (it == functions_.end() || it->second.definition != running_ || call.arguments.size() != it->second.parameters.size()) return false;
+    auto& function = it->second;
+    // running its definition again forgot the parsed body
+    if (!function.body) function.body = runtime_.parse_body(*function.definition);
+
+    calls_++;
+    tail_calls_++;
+    const size_t mark = tail_arguments_.size();
+    for (const auto& argument : call.arguments) {
+        Value value = evaluate_expression(*argument);
+        tail_arguments_.push_back(std::move(value));
+    }
+    const ArenaList<uint32_t>& parameters = function.body->layout->parameters;
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        environment_.local(parameters[i]) = std::move(tail_arguments_[mark + i]);
+    }
+    tail_arguments_.resize(mark);
+    return true;
 }
 
-void Evaluator::evaluate_loop(const LoopNode& loop) {
-    my_variant expression = evaluate_expression(*loop.condition);
-    if (long number = to_long(expression, loop.line, loop.column)) {
-        for (auto i = 0; i < number; ++i) {
-            evaluate_block(*loop.body, false);
+Evaluator::completion Evaluator::evaluate_loop(const LoopNode& loop) {
+    Value expression = evaluate_expression(*loop.condition);
+    if (long number = runtime_.to_long(expression, loop.position)) {
+        bool native = jit_ != nullptr;
+        for (long i = 0; i < number; ++i) {
+            if (native && jit_->hot(loop)) {
+                long remaining = jit_->loop(loop, environment_.locals(), number - i);
+                // no code for these types, or it bailed out right away: the interpreter goes on
+                if (remaining == number - i) native = false;
+                i = number - remaining;
+                if (i == number) break;
+            }
+            completion result = evaluate_block(*loop.body, false);
+            if (result != completion::normal) return result;
         }
-    } else if (bool *condition = get_if<bool>(&expression)) {
-        while (*condition) {
-            evaluate_block(*loop.body, false);
+    } else if (expression.is_bool()) {
+        bool condition = expression.as_bool();
+        while (condition) {
+            completion result = evaluate_block(*loop.body, false);
+            if (result != completion::normal) return result;
         }
     }
+    return completion::normal;
 }
 
-void Evaluator::evaluate_if_else(const IfElseNode& if_else) {
-    my_variant expression = evaluate_expression(*if_else.condition);
-    bool condition = to_boolean(expression, if_else.line, if_else.column);
+Evaluator::completion Evaluator::evaluate_if_else(const IfElseNode& if_else) {
+    Value expression = evaluate_expression(*if_else.condition);
+    bool condition = runtime_.to_boolean(expression, if_else.position);
     if (condition) {
-        evaluate_block(*if_else.if_branch, false);
+        return evaluate_block(*if_else.if_branch, false);
     } else if (if_else.else_branch) {
-        evaluate_block(*if_else.else_branch, false);
+        return evaluate_block(*if_else.else_branch, false);
     }
+    return completion::normal;
 }
 
-my_variant Evaluator::evaluate_expression(const ExpressionNode& expression) {
-    if (auto string = dynamic_cast<const StringLiteral*>(&expression)) {
-        return my_variant(string->value);
-
-    } else if (auto number = dynamic_cast<const LongNumberLiteral*>(&expression)) {
-        return my_variant(number->value);
+Value Evaluator::evaluate_expression(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+        return runtime_.string_literal(static_cast<const StringLiteral&>(expression).value);
 
-    } else if (auto number = dynamic_cast<const DoubleNumberLiteral*>(&expression)) {
-        return my_variant(number->value);
+    case NodeKind::LongNumberLiteral:
+        return Value(static_cast<const LongNumberLiteral&>(expression).value);
 
-    } else if (auto var = dynamic_cast<const VariableNode*>(&expression)) {
-        return get_variable(var->identifier);
+    case NodeKind::DoubleNumberLiteral:
+        return Value(static_cast<const DoubleNumberLiteral&>(expression).value);
 
-    } else if (auto bool_value = dynamic_cast<const BoolLiteral*>(&expression)) {
-        return my_variant(bool_value->value);
+    case NodeKind::Variable:
+        return get_variable(static_cast<const VariableNode&>(expression));
 
-    } else if (auto binary = dynamic_cast<const BinaryOpNode*>(&expression)) {
-        my_variant left = evaluate_expression(*binary->left);
-        my_variant right = evaluate_expression(*binary->right);
-        return evaluate_binary_op(binary->op, left, right, binary->line, binary->column);
+    case NodeKind::BoolLiteral:
+        return Value(static_cast<const BoolLiteral&>(expression).value);
 
-    } else if (auto unary = dynamic_cast<const UnaryOpNode*>(&expression)) {
-        my_variant operand = evaluate_expression(*unary->operand);
-        return evaluate_unary_op(unary->op, operand, unary->line, unary->column);
-
-    } else if (auto function_call = dynamic_cast<const FunctionCallNode*>(&expression)) {
-        return evaluate_function_call(*function_call);
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        if (Runtime::is_short_circuit(binary.op)) return short_circuit(binary);
+        Value left_value, right_value;
+        // a borrowed left operand would dangle if the right one grew the value stack
+        const Value& left = is_plain_read(*binary.right) ? borrow(*binary.left, left_value) : (left_value = evaluate_expression(*binary.left));
+        const Value& right = borrow(*binary.right, right_value);
+        return binary_op(binary, left, right);
+    }
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        Value operand = evaluate_expression(*unary.operand);
+        return runtime_.unary_op(unary.op, operand, unary.position);
+    }
+    case NodeKind::FunctionCall:
+        return evaluate_function_call(static_cast<const FunctionCallNode&>(expression));
 
-    } else {
+    default:
         throw runtime_error("Unknown expression");
     }
 }
 
-my_variant Evaluator::evaluate_binary_op(TokenType op, const my_variant& left, const my_variant& right, unsigned int line, unsigned int column) {
-    switch (op) {
-        // for long, doubles and booleans
-        case TokenType::LOGICAL_OR :
-        case TokenType::LOGICAL_AND : {
-            bool left_bool = to_boolean(left, line, column);
-            bool right_bool = to_boolean(right, line, column);
-            return (op == TokenType::LOGICAL_OR) ? (left_bool || right_bool) : (left_bool && right_bool);
-        }
-
-        // for long and doubles
-        case TokenType::LESS_THAN :
-        case TokenType::GREATER_THAN :
-        case TokenType::LESS_EQUAL :
-        case TokenType::GREATER_EQUAL : {
-            double left_double = to_double(left, line, column);
-            double right_double = to_double(right, line, column);
-            switch (op) {
-                case TokenType::LESS_THAN : return left_double < right_double;
-                case TokenType::GREATER_THAN : return left_double > right_double;
-                case TokenType::LESS_EQUAL :  return left_double <= right_double;
-                case TokenType::GREATER_EQUAL :  return left_double >= right_double;
-                default: throw runtime_error(error_message("Expected a number", line, column));
-            }
-        }
-        // for long, double, string and booleans
-        case TokenType::EQUAL : return are_equal(left, right, line, column);
-        case TokenType::NOT_EQUAL : return !are_equal(left, right, line, column);
+// two longs or two doubles are handled inline, before any feedback. for the other types, which at a
+// given operator hardly ever change, each node specializes itself on the ones it sees. the kernel it
+// is rewritten to runs behind a guard on those types, a failed guard sends the node back to observing
+Value Evaluator::binary_op(const BinaryOpNode& binary, const Value& left, const Value& right) {
+    Value result;
+    if (left.is_long() && right.is_long()) {
+        if (same_type_op(binary.op, left.as_long(), right.as_long(), result)) return result;
+    } else if (left.is_double() && right.is_double()) {
+        if (same_type_op(binary.op, left.as_double(), right.as_double(), result)) return result;
+    }
 
-        // for long, double and strings
-        case TokenType::PLUS : {
-            if (holds_alternative<string>(left) || holds_alternative<string>(right)) {
-                return variant_to_string(left, line, column) + variant_to_string(right, line, column);
-            } else if (is_number(left) && is_number(right)) {
-                if (holds_alternative<long>(left) && holds_alternative<long>(right)) {
-                    return get<long>(left) + get<long>(right);
-                } else {
-                    return to_double(left, line, column) + to_double(right, line, column);
-                }
-            }
-            throw runtime_error(error_message("Expected a string or a number", line, column));
-        }
-        // for long and doubles
-        case TokenType::MINUS :
-        case TokenType::MULTIPLY :
-        case TokenType::DIVIDE : {
-            double left_double = to_double(left, line, column);
-            double right_double = to_double(right, line, column);
-            switch (op) {
-                case TokenType::MINUS : return left_double - right_double;
-                case TokenType::MULTIPLY : return left_double * right_double;
-                case TokenType::DIVIDE : {
-                    if (right_double == 0) throw runtime_error(error_message("Division by zero", line, column));
-                    return left_double / right_double;
-                }
-                default: throw runtime_error(error_message("Expected a number", line, column));
-            }
+    BinaryFeedback& feedback = binary.feedback;
+    if (feedback.state == specialized) {
+        if (static_cast<uint8_t>(left.type()) == feedback.left_type && static_cast<uint8_t>(right.type()) == feedback.right_type) {
+            return Runtime::kernel(binary.op, left.type(), right.type())(runtime_, binary.op, left, right, binary.position);
         }
-        // for longs
-        case TokenType::MODULO : {
-            if (holds_alternative<long>(left) && holds_alternative<long>(right)) {
-                long right_long = get<long>(right);
-                if (right_long == 0) throw runtime_error(error_message("Division by zero", line, column));
-                return get<long>(left) % right_long;
-            }
-            throw runtime_error(error_message("Modulo requires integers", line, column));
+        quickening_.guard_failures++;
+        feedback.hits = 0;
+        if (++feedback.deoptimizations == max_deoptimizations) {
+            feedback.state = generic;
+            quickening_.generic++;
+        } else {
+            feedback.state = observing;
         }
-        default: throw runtime_error(error_message("Invallid operator", line, column));
+    } else if (feedback.state == observing) {
+        observe(binary, left, right);
     }
+    return runtime_.binary_op(binary.op, left, right, binary.position);
 }
 
-my_variant Evaluator::evaluate_unary_op(TokenType op, const my_variant& operand, unsigned int line, unsigned int column) {
-    if (op == TokenType::MINUS) {
-        if (holds_alternative<long>(operand)) return -get<long>(operand);
-        if (holds_alternative<double>(operand)) return -get<double>(operand);
-        throw runtime_error(error_message("Expected a number", line, column));
-    }
-    throw runtime_error(error_message("Invalid unary operator", line, column));
+Value Evaluator::short_circuit(const BinaryOpNode& binary) {
+    // and is decided by a false left operand, or by a true one
+    const bool decided = binary.op == TokenType::LOGICAL_OR;
+    Value temporary;
+    if (runtime_.to_boolean(borrow(*binary.left, temporary), binary.position) == decided) return Value(decided);
+    return Value(runtime_.to_boolean(borrow(*binary.right, temporary), binary.position));
 }
 
-bool Evaluator::is_number(const my_variant& value) {
-    return holds_alternative<long>(value) || holds_alternative<double>(value);
-}
+void Evaluator::observe(const BinaryOpNode& binary, const Value& left, const Value& right) {
+    BinaryFeedback& feedback = binary.feedback;
+    const uint8_t left_type = static_cast<uint8_t>(left.type()), right_type = static_cast<uint8_t>(right.type());
+    if (feedback.hits == 0 || left_type != feedback.left_type || right_type != feedback.right_type) {
+        feedback.left_type = left_type;
+        feedback.right_type = right_type;
+        feedback.hits = 0;
+    }
+    if (++feedback.hits < quicken_threshold) return;
 
-double Evaluator::to_double(const my_variant& value, unsigned int line, unsigned int column) {
-    if (holds_alternative<long>(value)) return static_cast<double>(get<long>(value));
-    if (holds_alternative<double>(value)) return get<double>(value);
-    throw runtime_error(error_message("Expected a number", line, column));
+    // types that only raise an error have no kernel of their own
+    if (Runtime::kernel(binary.op, left.type(), right.type()) == &Runtime::invalid_operands) {
+        feedback.state = generic;
+        quickening_.generic++;
+    } else {
+        feedback.state = specialized;
+        quickening_.specialized++;
+    }
 }
 
-long Evaluator::to_long(const my_variant& value, unsigned int line, unsigned int column) {
-    if (holds_alternative<long>(value)) return get<long>(value);
-    if (holds_alternative<double>(value)) throw runtime_error(error_message("Expected an integer", line, column));
-    throw runtime_error(error_message("Expected a number", line, column));
+const Value& Evaluator::get_variable(const VariableNode& variable) {
+    const Value* value = environment_.find(variable);
+    if (!value) throw runtime_.undefined_variable(variable.identifier);
+    return *value;
 }
 
-bool Evaluator::are_equal(const my_variant&left, const my_variant&right, unsigned int line, unsigned int column) {
-    if (holds_alternative<string>(left) && holds_alternative<string>(right)) return get<string>(left) == get<string>(right);
-    if (is_number(left) && is_number(right)) return to_double(left, line, column) == to_double(right, line, column);
-    if (holds_alternative<bool>(left) && holds_alternative<bool>(right)) return get<bool>(left) == get<bool>(right);
-    throw runtime_error(error_message("Unexpected types of operands", line, column));
-}
+// when s holds a string every + of the chain concatenates, the operands are evaluated
+// first and then appended to s
+bool Evaluator::append_in_place(const AssignmentNode& assignment) {
+    if (!environment_.local(assignment.slot).is_string()) return false;
+
+    const size_t mark = append_operands_.size();
+    collect_operands(*assignment.expression);
 
-bool Evaluator::to_boolean(const my_variant& value, unsigned int line, unsigned int column) {
-    if (holds_alternative<bool>(value)) return get<bool>(value);
-    if (holds_alternative<long>(value)) return get<long>(value) != 0;
-    if (holds_alternative<double>(value)) return get<double>(value) != 0.0;
-    throw runtime_error(error_message("Expected a boolean or a number", line, column));
+    Value& target = environment_.local(assignment.slot);
+    target = runtime_.append(std::move(target), append_operands_.data() + mark, append_operands_.size() - mark, assignment.position);
+    append_operands_.resize(mark);
+    return true;
 }
 
-string Evaluator::variant_to_string(const my_variant& value, unsigned int line, unsigned int column) {
-    if (holds_alternative<string>(value)) return get<string>(value);
-    if (holds_alternative<long>(value)) return to_string(get<long>(value));
-    if (holds_alternative<double>(value)) {
-        string str = to_string(get<double>(value));
-        str.erase(str.find_last_not_of('0') + 1, string::npos);
-        if (str.back() == '.') str.pop_back();
-        return str;
-    }
-    if (holds_alternative<bool>(value)) return get<bool>(value) ? "true" : "false";
-    if (holds_alternative<monostate>(value)) return "null";
-    throw runtime_error(error_message("Cannot convert to string", line, column));
+void Evaluator::collect_operands(const ExpressionNode& expression) {
+    if (expression.kind != NodeKind::BinaryOp) return;
+    auto& binary = static_cast<const BinaryOpNode&>(expression);
+    collect_operands(*binary.left);
+    Value operand = evaluate_expression(*binary.right);
+    append_operands_.push_back(std::move(operand));
 }
 
-string Evaluator::error_message(const string& message, unsigned int line, unsigned int column) {
-    // safely constructing the string
-    stringstream string_stream;
-    string_stream << "Error at " << line << ", " << column << " : " << message;
-    return string_stream.str();
+// variables are read in place, anything else is evaluated into temporary
+const Value& Evaluator::borrow(const ExpressionNode& expression, Value& temporary) {
+    if (expression.kind == NodeKind::Variable) return get_variable(static_cast<const VariableNode&>(expression));
+    return temporary = evaluate_expression(expression);
 }
 
-my_variant Evaluator::get_variable(const string& name) {
-    for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope) {
-        auto var = scope->find(name);
-        if (var != scope->end()) {
-            return var->second;
-        }
+bool Evaluator::is_plain_read(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::Variable:
+    case NodeKind::StringLiteral:
+    case NodeKind::LongNumberLiteral:
+    case NodeKind::DoubleNumberLiteral:
+    case NodeKind::BoolLiteral:
+        return true;
+    default:
+        return false;
     }
-    throw runtime_error("Undefined variable " + name);
 }
 
-void Evaluator::set_variable(const string& name, const my_variant& value) {
-    scopes_.back()[name] = value;
+void Evaluator::set_variable(uint32_t slot, Value value) {
+    environment_.set(slot, std::move(value));
+}
+
+void Evaluator::print_stats(ostream& out) const {
+    const auto& environment = environment_.statistics();
+    out << "calls: " << calls_ << endl;
+    out << "tail calls: " << tail_calls_ << endl;
+    out << "peak call depth: " << peak_depth_ << endl;
+    out << "scopes: " << environment.scopes << endl;
+    out << "value stack growths: " << environment.growths << endl;
+    out << "peak stack slots: " << environment.peak_slots << endl;
+    out << "binary operators specialized: " << quickening_.specialized << endl;
+    out << "guard failures: " << quickening_.guard_failures << endl;
+    out << "binary operators left generic: " << quickening_.generic << endl;
+    if (jit_) jit_->print_stats(out);
+    if (memo_) memo_->print_stats(out);
 }
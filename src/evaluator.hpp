@@ -1,69 +1,104 @@
 #pragma once
 
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
 #include <unordered_map>
-#include <variant>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "arena.hpp"
+#include "environment.hpp"
+#include "jit.hpp"
+#include "memo.hpp"
+#include "runtime.hpp"
+#include "symbols.hpp"
+
 #include "ast.hpp"
 #include "token.hpp"
+#include "value.hpp"
 
 using namespace std;
 
-
-// current possible types in the language
-using my_variant = variant<long, double, string, bool, monostate>;
-using native_function = function<my_variant(const vector<my_variant>&, unsigned int line, unsigned int column)>;
-
 class Evaluator {
 public:
-    Evaluator();
+    // memo_limit is the bytes the results of pure functions may take, 0 calls them every time
+    explicit Evaluator(bool jit = false, size_t memo_limit = 0);
     void evaluate(const ProgramNode& program);
+    void print_stats(ostream& out) const;
     virtual ~Evaluator();
 
 private:
     struct function_def {
-        vector<string> parameters;
+        ArenaList<Symbol> parameters;
+        // null until a pre-parsed body gets parsed on its first call
         const BlockNode* body;
+        const FunctionDefNode* definition;
     };
 
-    struct return_exception : exception {
-        my_variant value;
-        explicit return_exception(my_variant value) : value(std::move(value)) {}
-    };
-
-    unordered_map<string, my_variant> symbol_table_;
-    vector<unordered_map<string, my_variant>> scopes_;
-    unordered_map<string, function_def> functions_;
+    // how a statement finished, a return stops every enclosing block and loop up to its call.
+    // tail_call is a return of a call of the running function, whose arguments are already in
+    // its parameters: the call then runs the body again in the same frame
+    enum class completion { normal, returned, tail_call };
 
-    unordered_map<string, native_function> native_functions_;
-
-    void push_scope() { scopes_.push_back(unordered_map<string, my_variant>()); }
-    void pop_scope() { if (!scopes_.empty()) scopes_.pop_back(); }
-
-    my_variant get_variable(const string& name);
-    void set_variable(const string& name, const my_variant& value);
+    struct quickening_stats {
+        size_t specialized = 0;
+        size_t guard_failures = 0;
+        // nodes that deoptimized too often, or saw types no kernel is specialized for
+        size_t generic = 0;
+    };
 
-    void evaluate_block(const BlockNode& block, bool new_scope);
-    void evaluate_statement(const StatementNode& statement);
-    my_variant evaluate_function_call(const FunctionCallNode& call);
+    Runtime runtime_;
+
+    unordered_map<string, Value> symbol_table_;
+    Environment environment_;
+    // value of the return statement that completed last
+    Value return_value_;
+    // right operands of the appends being evaluated, nested appends stack theirs on top
+    vector<Value> append_operands_;
+    size_t calls_;
+    // calls that reused their caller's frame, and how deep calls got counting those frames too.
+    // native recursion only counts the frames the tree walker nests against its depth
+    size_t tail_calls_;
+    size_t depth_, peak_depth_, reused_frames_;
+    // null outside of any call
+    const FunctionDefNode* running_;
+    // arguments of a tail call, evaluated before any parameter is overwritten
+    vector<Value> tail_arguments_;
+    unordered_map<Symbol, function_def> functions_;
+    // null unless hot functions and loops are compiled to native code
+    unique_ptr<Jit> jit_;
+    // null unless calls of pure functions are memoized
+    unique_ptr<MemoCache> memo_;
+    quickening_stats quickening_;
+
+    void push_scope(const ScopeLayout& layout) { environment_.push(layout); }
+    void pop_scope() { environment_.pop(); }
+
+    const Value& get_variable(const VariableNode& variable);
+    const Value& borrow(const ExpressionNode& expression, Value& temporary);
+    bool is_plain_read(const ExpressionNode& expression);
+
+    bool append_in_place(const AssignmentNode& assignment);
+    void collect_operands(const ExpressionNode& expression);
+    void set_variable(uint32_t slot, Value value);
+
+    completion evaluate_block(const BlockNode& block, bool new_scope);
+    completion evaluate_statement(const StatementNode& statement);
+    Value evaluate_function_call(const FunctionCallNode& call);
+    bool tail_call(const FunctionCallNode& call);
     void evaluate_expression_statment(const ExpressionStatementNode& expression_statement);
 
-    void evaluate_loop(const LoopNode& loop);
-    void evaluate_if_else(const IfElseNode& if_else);
-
-    my_variant evaluate_expression(const ExpressionNode& expression);
-    my_variant evaluate_binary_op(TokenType op, const my_variant& left, const my_variant& right, unsigned int line, unsigned int column);
-    my_variant evaluate_unary_op(TokenType op, const my_variant& operand, unsigned int line, unsigned int column);
-
-    bool is_number(const my_variant& value);
-    double to_double(const my_variant& value, unsigned int line, unsigned int column);
-    long to_long(const my_variant& value, unsigned int line, unsigned int column);
-    bool to_boolean(const my_variant& value, unsigned int line, unsigned int column);
-    bool are_equal(const my_variant&left, const my_variant&right, unsigned int line, unsigned int column);
-    string variant_to_string(const my_variant& value, unsigned int line, unsigned int column);
+    completion evaluate_loop(const LoopNode& loop);
+    completion evaluate_if_else(const IfElseNode& if_else);
 
-    string error_message(const string& message, unsigned int line, unsigned int column);
+    Value evaluate_expression(const ExpressionNode& expression);
+    Value binary_op(const BinaryOpNode& binary, const Value& left, const Value& right);
+    Value short_circuit(const BinaryOpNode& binary);
+    void observe(const BinaryOpNode& binary, const Value& left, const Value& right);
 };
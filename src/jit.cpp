@@ -0,0 +1,1045 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include "jit.hpp"
+
+#ifdef SIA_JIT
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+Jit::Jit(Runtime& runtime) : runtime_(runtime), stack_limit_(nullptr), exhausted_(false) {
+#ifdef SIA_JIT
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+        void* address;
+        size_t size;
+        if (pthread_attr_getstack(&attributes, &address, &size) == 0) stack_limit_ = static_cast<const char*>(address);
+        pthread_attr_destroy(&attributes);
+    }
+#endif
+}
+
+Jit::~Jit() {
+#ifdef SIA_JIT
+    for (const auto& [address, size] : pages_) {
+        munmap(address, size);
+    }
+#endif
+}
+
+void Jit::print_stats(ostream& out) const {
+    out << "jit functions: " << stats_.functions << endl;
+    out << "jit loops: " << stats_.loops << endl;
+    out << "native calls: " << stats_.native_calls << endl;
+    out << "native loop runs: " << stats_.native_loops << endl;
+    out << "native iterations: " << stats_.native_iterations << endl;
+    out << "jit bailouts: " << stats_.bailouts << endl;
+    out << "jit type misses: " << stats_.type_misses << endl;
+    out << "jit depth misses: " << stats_.depth_misses << endl;
+}
+
+#ifdef SIA_JIT
+
+// native code reads and writes values in place: the type byte first, the payload 8 bytes in
+static_assert(sizeof(Value) == 16, "the JIT relies on the layout of Value");
+static constexpr int32_t payload_offset = 8;
+
+static uint64_t bits_of(const Value& value) {
+    uint64_t bits = 0;
+    switch (value.type()) {
+    case Value::Type::Long: bits = static_cast<uint64_t>(value.as_long()); break;
+    case Value::Type::Bool: bits = value.as_bool() ? 1 : 0; break;
+    case Value::Type::Double: {
+        double number = value.as_double();
+        memcpy(&bits, &number, sizeof(bits));
+        break;
+    }
+    default: break;
+    }
+    return bits;
+}
+
+static Value value_of(Value::Type type, uint64_t bits) {
+    switch (type) {
+    case Value::Type::Long: return Value(static_cast<long>(bits));
+    case Value::Type::Bool: return Value(bits != 0);
+    case Value::Type::Double: {
+        double number;
+        memcpy(&number, &bits, sizeof(number));
+        return Value(number);
+    }
+    default: return Value();
+    }
+}
+
+static bool is_native_type(Value::Type type) {
+    return type == Value::Type::Long || type == Value::Type::Double || type == Value::Type::Bool;
+}
+
+// every slot of the innermost scope a loop body reads or assigns
+static void collect_slots(const ExpressionNode& expression, vector<uint32_t>& slots) {
+    switch (expression.kind) {
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        if (variable.depth == 0 && variable.slot != no_slot) slots.push_back(variable.slot);
+        break;
+    }
+    case NodeKind::BinaryOp:
+        collect_slots(*static_cast<const BinaryOpNode&>(expression).left, slots);
+        collect_slots(*static_cast<const BinaryOpNode&>(expression).right, slots);
+        break;
+    case NodeKind::UnaryOp:
+        collect_slots(*static_cast<const UnaryOpNode&>(expression).operand, slots);
+        break;
+    case NodeKind::FunctionCall:
+        for (const auto& argument : static_cast<const FunctionCallNode&>(expression).arguments) {
+            collect_slots(*argument, slots);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void collect_slots(const ArenaList<StatementNode*>& statements, vector<uint32_t>& slots) {
+    for (const auto& statement : statements) {
+        switch (statement->kind) {
+        case NodeKind::Assignment:
+            slots.push_back(static_cast<const AssignmentNode&>(*statement).slot);
+            collect_slots(*static_cast<const AssignmentNode&>(*statement).expression, slots);
+            break;
+        case NodeKind::ExpressionStatement:
+            collect_slots(*static_cast<const ExpressionStatementNode&>(*statement).expression, slots);
+            break;
+        case NodeKind::Loop:
+            collect_slots(*static_cast<const LoopNode&>(*statement).condition, slots);
+            collect_slots(static_cast<const LoopNode&>(*statement).body->statements, slots);
+            break;
+        case NodeKind::IfElse: {
+            auto& if_else = static_cast<const IfElseNode&>(*statement);
+            collect_slots(*if_else.condition, slots);
+            collect_slots(if_else.if_branch->statements, slots);
+            if (if_else.else_branch) collect_slots(if_else.else_branch->statements, slots);
+            break;
+        }
+        case NodeKind::Return: {
+            auto& my_return = static_cast<const ReturnNode&>(*statement);
+            if (my_return.expression) collect_slots(*my_return.expression, slots);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+Jit::node_code& Jit::code_of(const ASTNode& node) {
+    auto it = nodes_.find(&node);
+    if (it != nodes_.end()) return it->second;
+    node_code& code = nodes_[&node];
+    if (node.kind == NodeKind::Block) {
+        for (uint32_t slot : static_cast<const BlockNode&>(node).layout->parameters) {
+            code.slots.push_back(slot);
+        }
+    } else {
+        collect_slots(static_cast<const LoopNode&>(node).body->statements, code.slots);
+        sort(code.slots.begin(), code.slots.end());
+        code.slots.erase(unique(code.slots.begin(), code.slots.end()), code.slots.end());
+    }
+    return code;
+}
+
+// general purpose registers, by encoding
+enum Register : uint8_t { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+enum class Condition : uint8_t {
+    OVERFLOW = 0x0, BELOW = 0x2, ABOVE_EQUAL = 0x3, EQUAL = 0x4, NOT_EQUAL = 0x5, ABOVE = 0x7,
+    PARITY = 0xA, NO_PARITY = 0xB, LESS = 0xC, GREATER_EQUAL = 0xD, LESS_EQUAL = 0xE, GREATER = 0xF,
+};
+
+// the few x86-64 instructions the code generator needs. all integer operations are 64-bit,
+// memory operands are a base register and a 32-bit displacement
+class Assembler {
+public:
+    vector<uint8_t> code;
+
+    // jumps to a label are patched by finish, once every label is bound
+    size_t label() {
+        targets_.push_back(SIZE_MAX);
+        return targets_.size() - 1;
+    }
+    void bind(size_t label) { targets_[label] = code.size(); }
+    void jmp(size_t label) { byte(0xE9); fixup(label); }
+    void jump_if(Condition condition, size_t label) { byte(0x0F); byte(0x80 | uint8_t(condition)); fixup(label); }
+    void finish() {
+        for (const auto& [at, label] : fixups_) {
+            int32_t relative = static_cast<int32_t>(targets_[label] - (at + 4));
+            memcpy(&code[at], &relative, sizeof(relative));
+        }
+    }
+
+    void push(Register r) { if (r >= R8) byte(0x41); byte(0x50 | (r & 7)); }
+    void pop(Register r) { if (r >= R8) byte(0x41); byte(0x58 | (r & 7)); }
+    void mov(Register dst, Register src) { rex(src, dst); byte(0x89); direct(src, dst); }
+    void mov(Register dst, uint64_t immediate) { rex(0, dst); byte(0xB8 | (dst & 7)); value(immediate, 8); }
+    void load(Register dst, Register base, int32_t displacement) { rex(dst, base); byte(0x8B); memory(dst, base, displacement); }
+    void store(Register base, int32_t displacement, Register src) { rex(src, base); byte(0x89); memory(src, base, displacement); }
+    void store_byte(Register base, int32_t displacement, uint8_t immediate) {
+        if (base >= R8) byte(0x41);
+        byte(0xC6);
+        memory(0, base, displacement);
+        byte(immediate);
+    }
+    void lea(Register dst, Register base, int32_t displacement) { rex(dst, base); byte(0x8D); memory(dst, base, displacement); }
+
+    void add(Register dst, Register src) { arithmetic(0x01, dst, src); }
+    void sub(Register dst, Register src) { arithmetic(0x29, dst, src); }
+    void and_(Register dst, Register src) { arithmetic(0x21, dst, src); }
+    void or_(Register dst, Register src) { arithmetic(0x09, dst, src); }
+    void xor_(Register dst, Register src) { arithmetic(0x31, dst, src); }
+    void cmp(Register left, Register right) { arithmetic(0x39, left, right); }
+    void test(Register left, Register right) { arithmetic(0x85, left, right); }
+    void add(Register dst, int32_t immediate) { rex(0, dst); byte(0x81); direct(0, dst); value(immediate, 4); }
+    void cmp(Register left, int32_t immediate) { rex(0, left); byte(0x81); direct(7, left); value(immediate, 4); }
+    void imul(Register dst, Register src) { rex(dst, src); byte(0x0F); byte(0xAF); direct(dst, src); }
+    void neg(Register r) { rex(0, r); byte(0xF7); direct(3, r); }
+    void cqo() { byte(0x48); byte(0x99); }
+    void idiv(Register r) { rex(0, r); byte(0xF7); direct(7, r); }
+    void decrement(Register base, int32_t displacement) { rex(0, base); byte(0xFF); memory(1, base, displacement); }
+    void compare_zero(Register base, int32_t displacement) { rex(0, base); byte(0x83); memory(7, base, displacement); byte(0); }
+    // only for the low byte of RAX to RBX
+    void set(Condition condition, Register r) { byte(0x0F); byte(0x90 | uint8_t(condition)); direct(0, r); }
+    void zero_extend_byte(Register dst, Register src) { byte(0x0F); byte(0xB6); direct(dst, src); }
+    void and_byte(Register dst, Register src) { byte(0x20); direct(src, dst); }
+    void or_byte(Register dst, Register src) { byte(0x08); direct(src, dst); }
+
+    void to_xmm(int xmm, Register r) { byte(0x66); rex(xmm, r); byte(0x0F); byte(0x6E); direct(xmm, r); }
+    void from_xmm(Register r, int xmm) { byte(0x66); rex(xmm, r); byte(0x0F); byte(0x7E); direct(xmm, r); }
+    void long_to_double(int xmm, Register r) { byte(0xF2); rex(xmm, r); byte(0x0F); byte(0x2A); direct(xmm, r); }
+    void addsd(int dst, int src) { sse(0xF2, 0x58, dst, src); }
+    void subsd(int dst, int src) { sse(0xF2, 0x5C, dst, src); }
+    void mulsd(int dst, int src) { sse(0xF2, 0x59, dst, src); }
+    void divsd(int dst, int src) { sse(0xF2, 0x5E, dst, src); }
+    void ucomisd(int left, int right) { sse(0x66, 0x2E, left, right); }
+    void xorpd(int dst, int src) { sse(0x66, 0x57, dst, src); }
+    void flip_bit(Register r, uint8_t bit) { rex(0, r); byte(0x0F); byte(0xBA); direct(7, r); byte(bit); }
+
+    // a call to the start of this code, for recursion
+    void call_start() {
+        byte(0xE8);
+        value(static_cast<uint32_t>(-static_cast<int32_t>(code.size() + 4)), 4);
+    }
+    void call(const void* target) { mov(RAX, reinterpret_cast<uint64_t>(target)); byte(0xFF); direct(2, RAX); }
+    void ret() { byte(0xC3); }
+
+private:
+    vector<size_t> targets_;
+    vector<pair<size_t, size_t>> fixups_;
+
+    void byte(uint8_t b) { code.push_back(b); }
+    void value(uint64_t v, int size) {
+        for (int i = 0; i < size; ++i) byte(static_cast<uint8_t>(v >> (8 * i)));
+    }
+    void fixup(size_t label) {
+        fixups_.push_back({ code.size(), label });
+        value(0, 4);
+    }
+    // REX.W with the high bits of the reg and r/m fields
+    void rex(int reg, int rm) { byte(0x48 | ((reg >> 3) << 2) | (rm >> 3)); }
+    void direct(int reg, int rm) { byte(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+    void memory(int reg, Register base, int32_t displacement) {
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP) byte(0x24);
+        value(static_cast<uint32_t>(displacement), 4);
+    }
+    void arithmetic(uint8_t opcode, Register dst, Register src) { rex(src, dst); byte(opcode); direct(src, dst); }
+    void sse(uint8_t prefix, uint8_t opcode, int dst, int src) { byte(prefix); byte(0x0F); byte(opcode); direct(dst, src); }
+};
+
+// emits the code of one specialization while checking its types. values are computed into RAX,
+// doubles into XMM0, and spilled to the native stack. RBX points at the slots, R12 holds the
+// result pointer of a function or the iterations left of a loop, R13 the recursion depth left
+class Jit::Codegen {
+public:
+    // thrown for what has no native code. a structural reason holds for every type of the node
+    struct unsupported {
+        bool structural;
+    };
+
+    explicit Codegen(Jit& jit) : jit_(jit), definition_(nullptr), body_(nullptr), signature_(nullptr), result_(Value::Type::Null), fail_(0), start_(0) {}
+
+    // frame: RBP, then RBX, R12, R13 and R14 pushed below it, then the slots or the loop's backups
+    static constexpr int32_t saved_registers = 32;
+
+    vector<uint8_t> function(const FunctionDefNode& definition, const BlockNode& body, const vector<Value::Type>& types, Value::Type result) {
+        definition_ = &definition;
+        body_ = &body;
+        signature_ = &types;
+        result_ = result;
+        const ScopeLayout& layout = *body.layout;
+        types_.assign(layout.names.size(), Value::Type::Unset);
+        assigned_.assign(layout.names.size(), false);
+        fail_ = a_.label();
+
+        prologue(8 * layout.names.size());
+        a_.mov(RBX, RSP);
+        a_.mov(R13, RDX);
+        // out of depth, Jit::call is told so through exhausted_
+        size_t deep_enough = a_.label();
+        a_.test(R13, R13);
+        a_.jump_if(Condition::GREATER, deep_enough);
+        a_.mov(RAX, reinterpret_cast<uint64_t>(&jit_.exhausted_));
+        a_.store_byte(RAX, 0, 1);
+        a_.jmp(fail_);
+        a_.bind(deep_enough);
+        a_.mov(R12, RSI);
+        const size_t count = layout.parameters.size();
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t slot = layout.parameters[i];
+            a_.load(RAX, RDI, 8 * (count - 1 - i));
+            a_.store(RBX, slot_offset(slot), RAX);
+            types_[slot] = types[i];
+            assigned_[slot] = true;
+        }
+        start_ = a_.label();
+        a_.bind(start_);
+        statements(body.statements);
+        // falling off the end returns null
+        if (!returns(body.statements)) throw unsupported{ true };
+
+        a_.bind(fail_);
+        a_.xor_(RAX, RAX);
+        epilogue();
+        a_.finish();
+        return std::move(a_.code);
+    }
+
+    vector<uint8_t> loop(const LoopNode& loop, const vector<uint32_t>& slots, const vector<Value::Type>& types) {
+        const uint32_t size = slots.empty() ? 0 : slots.back() + 1;
+        types_.assign(size, Value::Type::Unset);
+        assigned_.assign(size, false);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            types_[slots[i]] = types[i];
+            assigned_[slots[i]] = types[i] != Value::Type::Unset;
+        }
+        // a division can fail halfway through an iteration, the slots it wrote are then restored
+        // so that the interpreter can redo the whole iteration
+        vector<uint32_t> written;
+        if (can_fail(loop.body->statements)) {
+            collect_assigned(loop.body->statements, written);
+            sort(written.begin(), written.end());
+            written.erase(unique(written.begin(), written.end()), written.end());
+        }
+        fail_ = a_.label();
+        size_t next = a_.label(), done = a_.label();
+
+        prologue(16 * written.size());
+        a_.mov(RBX, RDI);
+        a_.mov(R12, RSI);
+        a_.bind(next);
+        a_.test(R12, R12);
+        a_.jump_if(Condition::LESS_EQUAL, done);
+        for (size_t i = 0; i < written.size(); ++i) {
+            copy_value(RBP, backup_offset(i), RBX, 16 * written[i]);
+        }
+        statements(loop.body->statements);
+        a_.add(R12, -1);
+        a_.jmp(next);
+
+        a_.bind(done);
+        a_.xor_(RAX, RAX);
+        epilogue();
+
+        a_.bind(fail_);
+        for (size_t i = 0; i < written.size(); ++i) {
+            copy_value(RBX, 16 * written[i], RBP, backup_offset(i));
+        }
+        a_.mov(RAX, R12);
+        epilogue();
+        a_.finish();
+        return std::move(a_.code);
+    }
+
+private:
+    Jit& jit_;
+    Assembler a_;
+    // set when compiling a function
+    const FunctionDefNode* definition_;
+    const BlockNode* body_;
+    const vector<Value::Type>* signature_;
+    Value::Type result_;
+    // static type of every slot, Unset until it is assigned
+    vector<Value::Type> types_;
+    // slots assigned on every path to the code being emitted, reading any other would look up the callers
+    vector<bool> assigned_;
+    size_t fail_;
+    // where a function's body starts, once its parameters are in their slots
+    size_t start_;
+
+    bool in_function() const { return definition_ != nullptr; }
+    // functions keep their slots in the native frame, loops work on the Values of the scope
+    int32_t slot_offset(uint32_t slot) const { return in_function() ? 8 * slot : 16 * slot + payload_offset; }
+    static int32_t backup_offset(size_t index) { return -saved_registers - 16 * static_cast<int32_t>(index + 1); }
+
+    void prologue(size_t frame) {
+        a_.push(RBP);
+        a_.mov(RBP, RSP);
+        a_.push(RBX);
+        a_.push(R12);
+        a_.push(R13);
+        a_.push(R14);
+        if (frame) a_.add(RSP, -static_cast<int32_t>((frame + 15) & ~size_t(15)));
+    }
+
+    // also drops whatever is left on the native stack
+    void epilogue() {
+        a_.lea(RSP, RBP, -saved_registers);
+        a_.pop(R14);
+        a_.pop(R13);
+        a_.pop(R12);
+        a_.pop(RBX);
+        a_.pop(RBP);
+        a_.ret();
+    }
+
+    void copy_value(Register to, int32_t to_offset, Register from, int32_t from_offset) {
+        a_.load(RAX, from, from_offset);
+        a_.store(to, to_offset, RAX);
+        a_.load(RAX, from, from_offset + 8);
+        a_.store(to, to_offset + 8, RAX);
+    }
+
+    static bool can_fail(const ExpressionNode& expression) {
+        switch (expression.kind) {
+        case NodeKind::BinaryOp: {
+            // divisions by zero, and long arithmetic that overflows
+            auto& binary = static_cast<const BinaryOpNode&>(expression);
+            switch (binary.op) {
+            case TokenType::PLUS:
+            case TokenType::MINUS:
+            case TokenType::MULTIPLY:
+            case TokenType::DIVIDE:
+            case TokenType::MODULO:
+                return true;
+            default:
+                return can_fail(*binary.left) || can_fail(*binary.right);
+            }
+        }
+        case NodeKind::UnaryOp:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool can_fail(const ArenaList<StatementNode*>& statements) {
+        for (const auto& statement : statements) {
+            switch (statement->kind) {
+            case NodeKind::Assignment:
+                if (can_fail(*static_cast<const AssignmentNode&>(*statement).expression)) return true;
+                break;
+            case NodeKind::ExpressionStatement:
+                if (can_fail(*static_cast<const ExpressionStatementNode&>(*statement).expression)) return true;
+                break;
+            case NodeKind::Loop: {
+                auto& loop = static_cast<const LoopNode&>(*statement);
+                if (can_fail(*loop.condition) || can_fail(loop.body->statements)) return true;
+                break;
+            }
+            case NodeKind::IfElse: {
+                auto& if_else = static_cast<const IfElseNode&>(*statement);
+                if (can_fail(*if_else.condition) || can_fail(if_else.if_branch->statements)) return true;
+                if (if_else.else_branch && can_fail(if_else.else_branch->statements)) return true;
+                break;
+            }
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    static void collect_assigned(const ArenaList<StatementNode*>& statements, vector<uint32_t>& slots) {
+        for (const auto& statement : statements) {
+            if (statement->kind == NodeKind::Assignment) {
+                slots.push_back(static_cast<const AssignmentNode&>(*statement).slot);
+            } else if (statement->kind == NodeKind::Loop) {
+                collect_assigned(static_cast<const LoopNode&>(*statement).body->statements, slots);
+            } else if (statement->kind == NodeKind::IfElse) {
+                auto& if_else = static_cast<const IfElseNode&>(*statement);
+                collect_assigned(if_else.if_branch->statements, slots);
+                if (if_else.else_branch) collect_assigned(if_else.else_branch->statements, slots);
+            }
+        }
+    }
+
+    // true when every path through statements ends in a return
+    static bool returns(const ArenaList<StatementNode*>& statements) {
+        for (const auto& statement : statements) {
+            if (statement->kind == NodeKind::Return) return true;
+            if (statement->kind == NodeKind::IfElse) {
+                auto& if_else = static_cast<const IfElseNode&>(*statement);
+                if (if_else.else_branch && returns(if_else.if_branch->statements) && returns(if_else.else_branch->statements)) return true;
+            }
+        }
+        return false;
+    }
+
+    void statements(const ArenaList<StatementNode*>& statements) {
+        for (const auto& statement : statements) {
+            this->statement(*statement);
+        }
+    }
+
+    void statement(const StatementNode& statement) {
+        switch (statement.kind) {
+        case NodeKind::Assignment: {
+            auto& assignment = static_cast<const AssignmentNode&>(statement);
+            Value::Type type = expression(*assignment.expression);
+            Value::Type& slot_type = types_[assignment.slot];
+            // the interpreter handles the variable changing type
+            if (slot_type != Value::Type::Unset && slot_type != type) throw unsupported{ false };
+            slot_type = type;
+            to_rax(type);
+            a_.store(RBX, slot_offset(assignment.slot), RAX);
+            if (!in_function()) a_.store_byte(RBX, 16 * assignment.slot, static_cast<uint8_t>(type));
+            assigned_[assignment.slot] = true;
+            break;
+        }
+        case NodeKind::ExpressionStatement:
+            expression(*static_cast<const ExpressionStatementNode&>(statement).expression);
+            break;
+
+        case NodeKind::Loop: {
+            auto& loop = static_cast<const LoopNode&>(statement);
+            // a double count is an error, left to the interpreter
+            if (expression(*loop.condition) != Value::Type::Long) throw unsupported{ false };
+            size_t next = a_.label(), done = a_.label();
+            a_.push(RAX);
+            a_.bind(next);
+            a_.compare_zero(RSP, 0);
+            a_.jump_if(Condition::LESS_EQUAL, done);
+            a_.decrement(RSP, 0);
+            // the body may not run at all
+            vector<bool> assigned = assigned_;
+            statements(loop.body->statements);
+            assigned_ = std::move(assigned);
+            a_.jmp(next);
+            a_.bind(done);
+            a_.add(RSP, 8);
+            break;
+        }
+        case NodeKind::IfElse: {
+            auto& if_else = static_cast<const IfElseNode&>(statement);
+            Value::Type type = expression(*if_else.condition);
+            to_rax(type);
+            boolean(RAX, type);
+            size_t skip_if = a_.label(), done = a_.label();
+            a_.test(RAX, RAX);
+            a_.jump_if(Condition::EQUAL, skip_if);
+            vector<bool> before = assigned_;
+            statements(if_else.if_branch->statements);
+            vector<bool> after_if = std::move(assigned_);
+            assigned_ = std::move(before);
+            a_.jmp(done);
+            a_.bind(skip_if);
+            if (if_else.else_branch) statements(if_else.else_branch->statements);
+            a_.bind(done);
+            for (size_t i = 0; i < assigned_.size(); ++i) {
+                assigned_[i] = assigned_[i] && after_if[i];
+            }
+            break;
+        }
+        case NodeKind::Return: {
+            auto& my_return = static_cast<const ReturnNode&>(statement);
+            if (!in_function() || !my_return.expression) throw unsupported{ true };
+            Value::Type type;
+            if (my_return.tail_call && is_self_call(static_cast<const FunctionCallNode&>(*my_return.expression))) {
+                auto& call = static_cast<const FunctionCallNode&>(*my_return.expression);
+                vector<Value::Type> types = push_arguments(call);
+                if (types == *signature_) {
+                    // the same specialization again: the arguments become the parameters, and
+                    // the body starts over in this frame
+                    const ScopeLayout& layout = *body_->layout;
+                    for (size_t i = layout.parameters.size(); i-- > 0;) {
+                        a_.pop(RAX);
+                        a_.store(RBX, slot_offset(layout.parameters[i]), RAX);
+                    }
+                    // drops the counts of the loops the return is in
+                    a_.mov(RSP, RBX);
+                    a_.jmp(start_);
+                    break;
+                }
+                type = call_pushed(types);
+            } else {
+                type = expression(*my_return.expression);
+            }
+            // every return has to give the type the specialization was compiled for
+            if (type != result_) throw unsupported{ false };
+            to_rax(result_);
+            a_.store(R12, 0, RAX);
+            a_.mov(RAX, uint64_t(1));
+            epilogue();
+            break;
+        }
+        default:
+            // bare blocks push scopes, definitions change the functions
+            throw unsupported{ true };
+        }
+    }
+
+    // moves a double from XMM0 to RAX, other types already are there
+    void to_rax(Value::Type type) {
+        if (type == Value::Type::Double) a_.from_xmm(RAX, 0);
+    }
+
+    // the operand in r as a double in xmm, booleans are errors of the interpreter
+    void to_double(Register r, Value::Type type, int xmm) {
+        if (type == Value::Type::Long) {
+            a_.long_to_double(xmm, r);
+        } else if (type == Value::Type::Double) {
+            a_.to_xmm(xmm, r);
+        } else {
+            throw unsupported{ false };
+        }
+    }
+
+    // the truth of the value in r, RAX or RCX, as 0 or 1 in r. clobbers RDX and XMM2
+    void boolean(Register r, Value::Type type) {
+        if (type == Value::Type::Long) {
+            a_.test(r, r);
+            a_.set(Condition::NOT_EQUAL, r);
+            a_.zero_extend_byte(r, r);
+        } else if (type == Value::Type::Double) {
+            // NaN is true
+            a_.to_xmm(0, r);
+            a_.xorpd(2, 2);
+            a_.ucomisd(0, 2);
+            a_.set(Condition::NOT_EQUAL, r);
+            a_.set(Condition::PARITY, RDX);
+            a_.or_byte(r, RDX);
+            a_.zero_extend_byte(r, r);
+        } else if (type != Value::Type::Bool) {
+            throw unsupported{ false };
+        }
+    }
+
+    Value::Type expression(const ExpressionNode& expression) {
+        switch (expression.kind) {
+        case NodeKind::LongNumberLiteral:
+            a_.mov(RAX, static_cast<uint64_t>(static_cast<const LongNumberLiteral&>(expression).value));
+            return Value::Type::Long;
+
+        case NodeKind::DoubleNumberLiteral:
+            a_.mov(RAX, bits_of(Value(static_cast<const DoubleNumberLiteral&>(expression).value)));
+            a_.to_xmm(0, RAX);
+            return Value::Type::Double;
+
+        case NodeKind::BoolLiteral:
+            a_.mov(RAX, uint64_t(static_cast<const BoolLiteral&>(expression).value ? 1 : 0));
+            return Value::Type::Bool;
+
+        case NodeKind::Variable: {
+            auto& variable = static_cast<const VariableNode&>(expression);
+            if (variable.depth != 0 || variable.slot == no_slot) throw unsupported{ true };
+            if (!assigned_[variable.slot]) throw unsupported{ false };
+            Value::Type type = types_[variable.slot];
+            a_.load(RAX, RBX, slot_offset(variable.slot));
+            if (type == Value::Type::Double) a_.to_xmm(0, RAX);
+            return type;
+        }
+        case NodeKind::BinaryOp:
+            return binary_op(static_cast<const BinaryOpNode&>(expression));
+
+        case NodeKind::UnaryOp: {
+            auto& unary = static_cast<const UnaryOpNode&>(expression);
+            Value::Type type = this->expression(*unary.operand);
+            if (unary.op != TokenType::MINUS) throw unsupported{ true };
+            if (type == Value::Type::Long) {
+                // -LONG_MIN is promoted to a double by the interpreter
+                a_.neg(RAX);
+                a_.jump_if(Condition::OVERFLOW, fail_);
+            } else if (type == Value::Type::Double) {
+                a_.from_xmm(RAX, 0);
+                a_.flip_bit(RAX, 63);
+                a_.to_xmm(0, RAX);
+            } else {
+                throw unsupported{ false };
+            }
+            return type;
+        }
+        case NodeKind::FunctionCall:
+            return call(static_cast<const FunctionCallNode&>(expression));
+
+        default:
+            // strings
+            throw unsupported{ true };
+        }
+    }
+
+    Value::Type binary_op(const BinaryOpNode& binary) {
+        if (Runtime::is_short_circuit(binary.op)) return short_circuit(binary);
+        Value::Type left = expression(*binary.left);
+        to_rax(left);
+        a_.push(RAX);
+        Value::Type right = expression(*binary.right);
+        to_rax(right);
+        a_.mov(RCX, RAX);
+        a_.pop(RAX);
+
+        const bool longs = left == Value::Type::Long && right == Value::Type::Long;
+        const bool bools = left == Value::Type::Bool && right == Value::Type::Bool;
+        const bool mixed = !longs && (left == Value::Type::Long || right == Value::Type::Long);
+        // long arithmetic that overflows is promoted to a double by the interpreter
+        switch (binary.op) {
+        case TokenType::PLUS:
+            if (longs) {
+                a_.add(RAX, RCX);
+                a_.jump_if(Condition::OVERFLOW, fail_);
+                return Value::Type::Long;
+            }
+            numbers(left, right);
+            a_.addsd(0, 1);
+            return Value::Type::Double;
+
+        case TokenType::MINUS:
+            if (longs) {
+                a_.sub(RAX, RCX);
+                a_.jump_if(Condition::OVERFLOW, fail_);
+                return Value::Type::Long;
+            }
+            numbers(left, right);
+            a_.subsd(0, 1);
+            return Value::Type::Double;
+
+        case TokenType::MULTIPLY:
+            if (longs) {
+                a_.imul(RAX, RCX);
+                a_.jump_if(Condition::OVERFLOW, fail_);
+                return Value::Type::Long;
+            }
+            numbers(left, right);
+            a_.mulsd(0, 1);
+            return Value::Type::Double;
+
+        case TokenType::DIVIDE: {
+            // the quotient of two longs is a long or a double depending on their values
+            if (longs) throw unsupported{ false };
+            numbers(left, right);
+            // division by zero is raised by the interpreter, NaN isn't zero
+            size_t divide = a_.label();
+            a_.xorpd(2, 2);
+            a_.ucomisd(1, 2);
+            a_.jump_if(Condition::PARITY, divide);
+            a_.jump_if(Condition::EQUAL, fail_);
+            a_.bind(divide);
+            a_.divsd(0, 1);
+            return Value::Type::Double;
+        }
+        case TokenType::MODULO: {
+            if (!longs) throw unsupported{ false };
+            size_t divide = a_.label(), done = a_.label();
+            a_.test(RCX, RCX);
+            a_.jump_if(Condition::EQUAL, fail_);
+            // idiv traps on LONG_MIN % -1, anything % -1 is 0
+            a_.cmp(RCX, -1);
+            a_.jump_if(Condition::NOT_EQUAL, divide);
+            a_.xor_(RAX, RAX);
+            a_.jmp(done);
+            a_.bind(divide);
+            a_.cqo();
+            a_.idiv(RCX);
+            a_.mov(RAX, RDX);
+            a_.bind(done);
+            return Value::Type::Long;
+        }
+        // longs are compared as longs and doubles as doubles, NaN compares false. a long against a
+        // double is compared exactly, which is left to the interpreter
+        case TokenType::LESS_THAN:
+            if (longs) return compare_longs(Condition::LESS);
+            if (mixed) throw unsupported{ false };
+            numbers(left, right);
+            return compare(1, 0, Condition::ABOVE);
+        case TokenType::GREATER_THAN:
+            if (longs) return compare_longs(Condition::GREATER);
+            if (mixed) throw unsupported{ false };
+            numbers(left, right);
+            return compare(0, 1, Condition::ABOVE);
+        case TokenType::LESS_EQUAL:
+            if (longs) return compare_longs(Condition::LESS_EQUAL);
+            if (mixed) throw unsupported{ false };
+            numbers(left, right);
+            return compare(1, 0, Condition::ABOVE_EQUAL);
+        case TokenType::GREATER_EQUAL:
+            if (longs) return compare_longs(Condition::GREATER_EQUAL);
+            if (mixed) throw unsupported{ false };
+            numbers(left, right);
+            return compare(0, 1, Condition::ABOVE_EQUAL);
+
+        case TokenType::EQUAL:
+        case TokenType::NOT_EQUAL: {
+            const bool equal = binary.op == TokenType::EQUAL;
+            if (mixed) throw unsupported{ false };
+            if (bools || longs) {
+                a_.cmp(RAX, RCX);
+                a_.set(equal ? Condition::EQUAL : Condition::NOT_EQUAL, RAX);
+            } else {
+                numbers(left, right);
+                a_.ucomisd(0, 1);
+                a_.set(equal ? Condition::EQUAL : Condition::NOT_EQUAL, RAX);
+                a_.set(equal ? Condition::NO_PARITY : Condition::PARITY, RCX);
+                if (equal) {
+                    a_.and_byte(RAX, RCX);
+                } else {
+                    a_.or_byte(RAX, RCX);
+                }
+            }
+            a_.zero_extend_byte(RAX, RAX);
+            return Value::Type::Bool;
+        }
+        default:
+            throw unsupported{ true };
+        }
+    }
+
+    // the right operand only runs when the left one doesn't decide, the result is the truth of the
+    // last one evaluated
+    Value::Type short_circuit(const BinaryOpNode& binary) {
+        Value::Type left = expression(*binary.left);
+        to_rax(left);
+        boolean(RAX, left);
+        size_t done = a_.label();
+        a_.test(RAX, RAX);
+        a_.jump_if(binary.op == TokenType::LOGICAL_AND ? Condition::EQUAL : Condition::NOT_EQUAL, done);
+        Value::Type right = expression(*binary.right);
+        to_rax(right);
+        boolean(RAX, right);
+        a_.bind(done);
+        return Value::Type::Bool;
+    }
+
+    // the operands, in RAX and RCX, as doubles in XMM0 and XMM1
+    void numbers(Value::Type left, Value::Type right) {
+        to_double(RAX, left, 0);
+        to_double(RCX, right, 1);
+    }
+
+    Value::Type compare(int left, int right, Condition condition) {
+        a_.ucomisd(left, right);
+        a_.set(condition, RAX);
+        a_.zero_extend_byte(RAX, RAX);
+        return Value::Type::Bool;
+    }
+
+    // RAX against RCX
+    Value::Type compare_longs(Condition condition) {
+        a_.cmp(RAX, RCX);
+        a_.set(condition, RAX);
+        a_.zero_extend_byte(RAX, RAX);
+        return Value::Type::Bool;
+    }
+
+    bool is_self_call(const FunctionCallNode& call) const {
+        return in_function() && call.name == definition_->name && !jit_.runtime_.native(call.name)
+            && call.arguments.size() == definition_->parameters.size();
+    }
+
+    // only a function calling itself, natively through the specialization for the arguments' types
+    Value::Type call(const FunctionCallNode& call) {
+        if (!is_self_call(call)) throw unsupported{ true };
+        return call_pushed(push_arguments(call));
+    }
+
+    // the arguments' values on the native stack, the last one on top
+    vector<Value::Type> push_arguments(const FunctionCallNode& call) {
+        vector<Value::Type> types;
+        for (const auto& argument : call.arguments) {
+            Value::Type type = expression(*argument);
+            to_rax(type);
+            a_.push(RAX);
+            types.push_back(type);
+        }
+        return types;
+    }
+
+    Value::Type call_pushed(const vector<Value::Type>& types) {
+        const specialization* target = nullptr;
+        Value::Type result = result_;
+        if (types != *signature_) {
+            target = jit_.function_specialization(*definition_, *body_, types);
+            if (!target || !target->code) throw unsupported{ false };
+            result = target->result;
+        }
+
+        a_.mov(RDI, RSP);
+        a_.add(RSP, -16);
+        a_.mov(RSI, RSP);
+        a_.lea(RDX, R13, -1);
+        if (target) {
+            a_.call(target->code);
+        } else {
+            a_.call_start();
+        }
+        a_.load(RCX, RSP, 0);
+        a_.add(RSP, static_cast<int32_t>(16 + 8 * types.size()));
+        a_.test(RAX, RAX);
+        a_.jump_if(Condition::EQUAL, fail_);
+        a_.mov(RAX, RCX);
+        if (result == Value::Type::Double) a_.to_xmm(0, RAX);
+        return result;
+    }
+};
+
+void* Jit::install(const vector<uint8_t>& code) {
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t size = (code.size() + page - 1) / page * page;
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return nullptr;
+    memcpy(memory, code.data(), code.size());
+    // never writable and executable at once
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    pages_.push_back({ memory, size });
+    return memory;
+}
+
+Jit::specialization* Jit::function_specialization(const FunctionDefNode& definition, const BlockNode& body, const vector<Value::Type>& types) {
+    node_code& code = code_of(body);
+    for (const auto& known : code.specializations) {
+        // a function calling itself back with the types being compiled has no code yet
+        if (known->types == types) return known->compiling ? nullptr : known.get();
+    }
+    if (code.specializations.size() >= max_specializations) return nullptr;
+    code.specializations.push_back(make_unique<specialization>());
+    specialization& compiled = *code.specializations.back();
+    compiled.types = types;
+    compiled.compiling = true;
+
+    // the type returned is found by trying each one, every return has to give it
+    for (Value::Type result : { Value::Type::Long, Value::Type::Double, Value::Type::Bool }) {
+        try {
+            compiled.code = install(Codegen(*this).function(definition, body, types, result));
+            compiled.result = result;
+            stats_.functions++;
+            break;
+        } catch (const Codegen::unsupported& e) {
+            if (e.structural) {
+                definition.hotness = never;
+                break;
+            }
+        }
+    }
+    compiled.compiling = false;
+    return &compiled;
+}
+
+Jit::specialization* Jit::loop_specialization(const LoopNode& loop, node_code& code, const vector<Value::Type>& types) {
+    for (const auto& known : code.specializations) {
+        if (known->types == types) return known.get();
+    }
+    if (code.specializations.size() >= max_specializations) return nullptr;
+    code.specializations.push_back(make_unique<specialization>());
+    specialization& compiled = *code.specializations.back();
+    compiled.types = types;
+    try {
+        compiled.code = install(Codegen(*this).loop(loop, code.slots, types));
+        stats_.loops++;
+    } catch (const Codegen::unsupported& e) {
+        if (e.structural) loop.hotness = never;
+    }
+    return &compiled;
+}
+
+bool Jit::call(const FunctionDefNode& definition, const BlockNode& body, const Value* slots, Value& result, size_t depth) {
+    node_code& code = code_of(body);
+    if (depth > code.exhausted_at) {
+        stats_.depth_misses++;
+        return false;
+    }
+    code.exhausted_at = SIZE_MAX;
+    // the interpreted calls under this one count against max_depth, and native frames have to fit
+    // in the stack they left
+    int64_t budget = max_depth - static_cast<int64_t>(min(depth, static_cast<size_t>(max_depth)));
+    if (stack_limit_) {
+        const char* here = static_cast<const char*>(__builtin_frame_address(0));
+        const size_t left = here > stack_limit_ + stack_reserve ? here - stack_limit_ - stack_reserve : 0;
+        budget = min(budget, static_cast<int64_t>(left / frame_bytes));
+    }
+    if (budget <= 0) {
+        stats_.depth_misses++;
+        return false;
+    }
+    types_.clear();
+    for (uint32_t slot : code.slots) {
+        types_.push_back(slots[slot].type());
+        if (!is_native_type(types_.back())) {
+            stats_.type_misses++;
+            return false;
+        }
+    }
+    const specialization* compiled = function_specialization(definition, body, types_);
+    if (!compiled || !compiled->code) {
+        stats_.type_misses++;
+        return false;
+    }
+
+    const size_t count = code.slots.size();
+    arguments_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        arguments_[count - 1 - i] = bits_of(slots[code.slots[i]]);
+    }
+    stats_.native_calls++;
+    uint64_t bits;
+    exhausted_ = false;
+    if (!reinterpret_cast<function_code>(compiled->code)(arguments_.data(), &bits, budget)) {
+        stats_.bailouts++;
+        if (exhausted_) code.exhausted_at = depth;
+        return false;
+    }
+    result = value_of(compiled->result, bits);
+    return true;
+}
+
+long Jit::loop(const LoopNode& loop, Value* locals, long count) {
+    node_code& code = code_of(loop);
+    types_.clear();
+    for (uint32_t slot : code.slots) {
+        types_.push_back(locals[slot].type());
+        if (!is_native_type(types_.back()) && types_.back() != Value::Type::Unset) {
+            stats_.type_misses++;
+            return count;
+        }
+    }
+    const specialization* compiled = loop_specialization(loop, code, types_);
+    if (!compiled || !compiled->code) {
+        stats_.type_misses++;
+        return count;
+    }
+
+    stats_.native_loops++;
+    long remaining = reinterpret_cast<loop_code>(compiled->code)(locals, count);
+    stats_.native_iterations += count - remaining;
+    if (remaining > 0) stats_.bailouts++;
+    return remaining;
+}
+
+#else
+
+bool Jit::call(const FunctionDefNode&, const BlockNode&, const Value*, Value&, size_t) {
+    return false;
+}
+
+long Jit::loop(const LoopNode&, Value*, long count) {
+    return count;
+}
+
+#endif
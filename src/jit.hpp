@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// native code is only emitted on x86-64 Linux, elsewhere every call and loop stays interpreted
+#if defined(__x86_64__) && defined(__linux__) && !defined(SIA_NO_JIT)
+#define SIA_JIT
+#endif
+
+// baseline JIT of the tree walker. functions and loops that only compute with longs, doubles
+// and booleans in their own scope are compiled to x86-64 once they are hot, one specialization
+// per set of argument or variable types. the interpreter checks the types before entering
+// native code, and native code bails out to the interpreter instead of raising an error
+class Jit {
+public:
+    explicit Jit(Runtime& runtime);
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    virtual ~Jit();
+
+    // count a call or an iteration, true once the node is hot enough to look for native code
+    bool hot(const FunctionDefNode& definition) { return counted(definition.hotness, function_threshold); }
+    bool hot(const LoopNode& loop) { return counted(loop.hotness, loop_threshold); }
+
+    // runs a call natively when there is code for the types of its arguments, which are in
+    // the parameter slots of the callee's reserved scope. depth is the number of interpreted calls
+    // under this one. false when the interpreter has to run it
+    bool call(const FunctionDefNode& definition, const BlockNode& body, const Value* slots, Value& result, size_t depth);
+    // runs up to count iterations natively over the innermost scope's slots and returns how many
+    // are left, all of them when there is no code for the variables' types
+    long loop(const LoopNode& loop, Value* locals, long count);
+
+    void print_stats(ostream& out) const;
+
+private:
+    class Codegen;
+
+    static constexpr uint32_t function_threshold = 100;
+    static constexpr uint32_t loop_threshold = 1000;
+    // hotness of a node that can't be compiled
+    static constexpr uint32_t never = UINT32_MAX;
+    static constexpr size_t max_specializations = 4;
+    // native recursion bails out past this depth, counting the interpreted calls under it, and the
+    // interpreter then redoes the call. kept well below what the tree walker recurses to on a
+    // default stack, so that it can always finish what native code gave up on
+    static constexpr int64_t max_depth = 5000;
+    // stack a native frame may take at most, and stack left to the interpreter below native code
+    static constexpr size_t frame_bytes = 256;
+    static constexpr size_t stack_reserve = 256 << 10;
+
+    // arguments in reverse order, so that native callers can pass the ones they pushed
+    using function_code = int64_t (*)(const uint64_t* arguments, uint64_t* result, int64_t depth);
+    using loop_code = int64_t (*)(Value* locals, int64_t count);
+
+    struct specialization {
+        // types of the node's slots
+        vector<Value::Type> types;
+        // null when the body can't be compiled for these types
+        void* code = nullptr;
+        Value::Type result = Value::Type::Null;
+        bool compiling = false;
+    };
+
+    // what a function body or a loop has been compiled to
+    struct node_code {
+        // the slots whose types select a specialization: a function's parameters, or every slot a loop uses
+        vector<uint32_t> slots;
+        vector<unique_ptr<specialization>> specializations;
+        // interpreted depth of the last call whose native recursion ran out of depth. calls deeper
+        // than it would run out as well, they stay interpreted until the stack unwinds to it
+        size_t exhausted_at = SIZE_MAX;
+    };
+
+    struct stats {
+        size_t functions = 0;
+        size_t loops = 0;
+        size_t native_calls = 0;
+        size_t native_loops = 0;
+        size_t native_iterations = 0;
+        // native code that gave up, the interpreter redid the call or the iteration
+        size_t bailouts = 0;
+        // entries whose types had no code
+        size_t type_misses = 0;
+        // calls left to the interpreter because native recursion would run out of depth
+        size_t depth_misses = 0;
+    };
+
+    Runtime& runtime_;
+    // by function body or loop
+    unordered_map<const ASTNode*, node_code> nodes_;
+    // mapped pages holding the code, with their sizes
+    vector<pair<void*, size_t>> pages_;
+    stats stats_;
+    // scratch space of call and loop
+    vector<Value::Type> types_;
+    vector<uint64_t> arguments_;
+    // lowest address of the stack, and set by native code that ran out of depth
+    const char* stack_limit_;
+    bool exhausted_;
+
+    static bool counted(uint32_t& hotness, uint32_t threshold) {
+        if (hotness >= threshold) return hotness != never;
+        hotness++;
+        return false;
+    }
+
+    node_code& code_of(const ASTNode& node);
+    specialization* function_specialization(const FunctionDefNode& definition, const BlockNode& body, const vector<Value::Type>& types);
+    specialization* loop_specialization(const LoopNode& loop, node_code& code, const vector<Value::Type>& types);
+    void* install(const vector<uint8_t>& code);
+};
@@ -1,69 +1,29 @@
+#include <algorithm>
+#include <cstring>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "lexer.hpp"
+#include "scan.hpp"
 #include "token.hpp"
 
 using namespace std;
 
-Lexer::Lexer() {
-    spec_ = {
-        // whitespaces
-        {regex(R"(^[ \t\v\f]+)"), nullopt},
-        {regex(R"(^(\r\n|\n|\r))"), TokenType::NEWLINE},
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+static bool is_word(char c) { return is_alpha(c) || is_digit(c) || c == '_'; }
 
-        // comments
-        {regex(R"(^\/\/.*)"), nullopt},
-        {regex(R"(^\/\*[\s\S]*?\*\/)"), nullopt},
+Lexer::Lexer() : cursor_(0), line_(1), column_(1), unterminated_comment_(false) {}
 
-        // symbols
-        {regex(R"(^;)"), TokenType::SEMICOLON},
-        {regex(R"(^\{)"), TokenType::LEFT_BRACE},
-        {regex(R"(^\})"), TokenType::RIGHT_BRACE},
-        {regex(R"(^\()"), TokenType::LEFT_PAREN},
-        {regex(R"(^\))"), TokenType::RIGHT_PAREN},
-        {regex(R"(^,)"), TokenType::COMMA},
-
-        {regex(R"(^<=)"), TokenType::LESS_EQUAL},
-        {regex(R"(^>=)"), TokenType::GREATER_EQUAL},
-        {regex(R"(^==)"), TokenType::EQUAL},
-        {regex(R"(^!=)"), TokenType::NOT_EQUAL},
-        {regex(R"(^and\b)"), TokenType::LOGICAL_AND},
-        {regex(R"(^or\b)"), TokenType::LOGICAL_OR},
-
-        {regex(R"(^\+)"), TokenType::PLUS},
-        {regex(R"(^\-)"), TokenType::MINUS},
-        {regex(R"(^\*)"), TokenType::MULTIPLY},
-        {regex(R"(^\/)"), TokenType::DIVIDE},
-        {regex(R"(^%)"), TokenType::MODULO},
-
-        {regex(R"(^<)"), TokenType::LESS_THAN},
-        {regex(R"(^>)"), TokenType::GREATER_THAN},
-        {regex(R"(^=)"), TokenType::ASSIGN},
-
-        // keywords
-        {regex(R"(^function\b)"), TokenType::FUNCTION}, // '\b' ensures that the keyword is not matched if it's a part of a larger word
-        {regex(R"(^return\b)"), TokenType::RETURN},
-        {regex(R"(^loop\b)"), TokenType::LOOP},
-        {regex(R"(^if\b)"), TokenType::IF},
-        {regex(R"(^else\b)"), TokenType::ELSE},
-
-        // literals
-        {regex(R"(^\d+\.?\d*)"), TokenType::NUMBER},
-        {regex(R"(^"[^"]*")"), TokenType::STRING},
-        {regex(R"(^true\b)"), TokenType::TRUE},
-        {regex(R"(^false\b)"), TokenType::FALSE},
-
-        // identifiers
-        {regex(R"(^[a-zA-Z][a-zA-Z0-9_]*)"), TokenType::IDENTIFIER},
-    };
-}
-
-void Lexer::init(const string& input) {
+void Lexer::init(string_view input, unsigned int line, unsigned int column) {
     input_ = input;
     cursor_ = 0;
-    this->line_ = 1;
-    this->column_ = 1;
+    this->line_ = line;
+    this->column_ = column;
+    unterminated_comment_ = false;
 }
 
 bool Lexer::has_more_tokens() const {
@@ -74,39 +34,233 @@ bool Lexer::is_EOF() const {
     return cursor_ == input_.length();
 }
 
-// TODO -> optimize looking thru spec_
-//
+// skips blanks, newlines and comments - they don't move the column, line breaks reset it
+void Lexer::skip_whitespace_and_comments() {
+    const char* data = input_.data();
+    const unsigned int length = input_.length();
+
+    while (cursor_ < length) {
+        switch (input_[cursor_]) {
+            case ' ': case '\t': case '\v': case '\f':
+                cursor_ = scan_blanks(data + cursor_, data + length) - data;
+                break;
+
+            case '\r':
+                // "\r\n" counts as a single newline
+                if (cursor_ + 1 < length && input_[cursor_ + 1] == '\n') cursor_++;
+                [[fallthrough]];
+            case '\n':
+                cursor_++;
+                line_++; column_ = 1;
+                break;
+
+            case '/': {
+                if (cursor_ + 1 >= length) return;
+                if (input_[cursor_ + 1] == '/') {
+                    // line comment, the line break itself is handled by the next iteration
+                    cursor_ = scan_line_end(data + cursor_ + 2, data + length) - data;
+                } else if (input_[cursor_ + 1] == '*') {
+                    // an unterminated block comment is lexed as "/" followed by "*"
+                    size_t newlines = 0;
+                    const char* close = scan_block_comment_end(data + cursor_ + 2, data + length, newlines);
+                    if (close == data + length) {
+                        unterminated_comment_ = true;
+                        return;
+                    }
+                    if (newlines) { line_ += newlines; column_ = 1; }
+                    cursor_ = close + 2 - data;
+                } else {
+                    return;
+                }
+                break;
+            }
+
+            default:
+                return;
+        }
+    }
+}
+
 optional<Token> Lexer::get_next_token() {
+    skip_whitespace_and_comments();
     if (!this->has_more_tokens()) return nullopt;
-    const string input = input_.substr(cursor_);
 
-    for (const auto& [regex, token_type] : spec_) {
-        const optional<string> token_value = match(regex, input);
+    const unsigned int start = cursor_;
+    const char c = input_[start];
+    const char next = start + 1 < input_.length() ? input_[start + 1] : '\0';
 
-        if (token_value == nullopt) continue;
+    switch (c) {
+        // symbols
+        case ';': return make_token(TokenType::SEMICOLON, start, 1);
+        case '{': return make_token(TokenType::LEFT_BRACE, start, 1);
+        case '}': return make_token(TokenType::RIGHT_BRACE, start, 1);
+        case '(': return make_token(TokenType::LEFT_PAREN, start, 1);
+        case ')': return make_token(TokenType::RIGHT_PAREN, start, 1);
+        case ',': return make_token(TokenType::COMMA, start, 1);
 
-        if (token_type == nullopt) return get_next_token();
+        // operators
+        case '+': return make_token(TokenType::PLUS, start, 1);
+        case '-': return make_token(TokenType::MINUS, start, 1);
+        case '*': return make_token(TokenType::MULTIPLY, start, 1);
+        case '/': return make_token(TokenType::DIVIDE, start, 1);
+        case '%': return make_token(TokenType::MODULO, start, 1);
+        case '<': return next == '=' ? make_token(TokenType::LESS_EQUAL, start, 2) : make_token(TokenType::LESS_THAN, start, 1);
+        case '>': return next == '=' ? make_token(TokenType::GREATER_EQUAL, start, 2) : make_token(TokenType::GREATER_THAN, start, 1);
+        case '=': return next == '=' ? make_token(TokenType::EQUAL, start, 2) : make_token(TokenType::ASSIGN, start, 1);
+        case '!': if (next == '=') return make_token(TokenType::NOT_EQUAL, start, 2); break;
 
-        if (token_type.value() == TokenType::NEWLINE) {
-            line_++; column_ = 1;
-            return get_next_token();
-        }
+        // literals
+        case '"': return scan_string(start);
 
-        string lexeme = token_value.value();
-        if (token_type.value() == TokenType::STRING) {
-            lexeme = lexeme.substr(1, lexeme.size() - 2);
-        }
+        default:
+            if (is_digit(c)) return scan_number(start);
+            if (is_alpha(c)) return scan_identifier(start);
+            break;
+    }
+
+    throw runtime_error("Unexpected input: \"" + string(1, c) + "\" at " + to_string(line_) + ", " + to_string(column_));
+}
+
+Token Lexer::make_token(TokenType token_type, unsigned int start, unsigned int length) {
+    cursor_ = start + length;
+    column_ += length;
+    return Token{token_type, input_.substr(start, length), this->line_, this->column_};
+}
+
+Token Lexer::scan_number(unsigned int start) {
+    // digits, optionally followed by a dot and more digits
+    unsigned int end = start;
+    while (end < input_.length() && is_digit(input_[end])) end++;
+    if (end < input_.length() && input_[end] == '.') {
+        end++;
+        while (end < input_.length() && is_digit(input_[end])) end++;
+    }
+    return make_token(TokenType::NUMBER, start, end - start);
+}
 
-        column_ += token_value.value().length();
-        return Token{token_type.value(), lexeme, this->line_, this->column_};
+Token Lexer::scan_string(unsigned int start) {
+    const char* data = input_.data();
+    size_t newlines = 0;
+    const char* close = scan_quote(data + start + 1, data + input_.length(), newlines);
+    if (close == data + input_.length()) {
+        throw runtime_error("Unexpected input: \"\"\" at " + to_string(line_) + ", " + to_string(column_));
     }
 
-    throw runtime_error("Unexpected input: \"" + string(1, input[0]) + "\" at " + to_string(line_) + ", " + to_string(column_));
+    // the lexeme drops the quotes but the column still accounts for them,
+    // for multi-line strings it only counts what follows the last line break
+    const unsigned int end = close + 1 - data;
+    if (newlines) {
+        line_ += newlines;
+        column_ = 1 + end - (scan_last_line(data + start + 1, close) - data);
+    } else {
+        column_ += end - start;
+    }
+    cursor_ = end;
+    return Token{TokenType::STRING, input_.substr(start + 1, end - start - 2), this->line_, this->column_};
 }
 
-optional<string> Lexer::match(const regex& pattern, const string& str) {
-    smatch matched;
-    if (!regex_search(str, matched, pattern)) return nullopt;
-    cursor_ += matched[0].length();
-    return matched[0];
+Token Lexer::scan_identifier(unsigned int start) {
+    unsigned int end = start;
+    while (end < input_.length() && is_word(input_[end])) end++;
+
+    const unsigned int length = end - start;
+    optional<TokenType> keyword = keyword_type(input_.data() + start, length);
+    return make_token(keyword.value_or(TokenType::IDENTIFIER), start, length);
+}
+
+// keywords are only recognized as whole words, so "iffy" or "and_x" stay identifiers
+optional<TokenType> Lexer::keyword_type(const char* lexeme, unsigned int length) const {
+    auto is = [&](const char* keyword) { return strlen(keyword) == length && memcmp(lexeme, keyword, length) == 0; };
+
+    switch (lexeme[0]) {
+        case 'a': if (is("and")) return TokenType::LOGICAL_AND; break;
+        case 'e': if (is("else")) return TokenType::ELSE; break;
+        case 'f':
+            if (is("function")) return TokenType::FUNCTION;
+            if (is("false")) return TokenType::FALSE;
+            break;
+        case 'i': if (is("if")) return TokenType::IF; break;
+        case 'l': if (is("loop")) return TokenType::LOOP; break;
+        case 'o': if (is("or")) return TokenType::LOGICAL_OR; break;
+        case 'r': if (is("return")) return TokenType::RETURN; break;
+        case 't': if (is("true")) return TokenType::TRUE; break;
+    }
+    return nullopt;
+}
+
+// chunks start right after a '\n', speculating that it isn't inside a string or a block comment.
+// a chunk lexed from a correct start is right as long as nothing in it runs past its end,
+// so chunks are checked in order and the first one that doesn't end cleanly is lexed again,
+// together with the rest of the input, on the calling thread
+TokenStream Lexer::tokenize(string_view input, unsigned int threads) {
+    vector<size_t> bounds = {0};
+    for (unsigned int i = 1; i < threads; i++) {
+        size_t newline = input.find('\n', max(bounds.back(), input.length() / threads * i));
+        if (newline == string_view::npos) break;
+        if (newline + 1 < input.length()) bounds.push_back(newline + 1);
+    }
+    bounds.push_back(input.length());
+
+    const size_t count = bounds.size() - 1;
+    vector<Chunk> chunks(count);
+    vector<thread> workers;
+    for (size_t i = 1; i < count; i++) {
+        workers.emplace_back(lex_chunk, input.substr(bounds[i], bounds[i + 1] - bounds[i]), 1, i + 1 == count, ref(chunks[i]));
+    }
+    lex_chunk(input.substr(0, bounds[1]), 1, count == 1, chunks[0]);
+    for (auto& worker : workers) worker.join();
+
+    // chunks that ended cleanly, with the line and token index they start at
+    vector<unsigned int> first_lines;
+    vector<size_t> offsets;
+    unsigned int line = 1;
+    size_t total = 0;
+    size_t valid = 0;
+    for (; valid < count && chunks[valid].clean; valid++) {
+        first_lines.push_back(line);
+        offsets.push_back(total);
+        line += chunks[valid].end_line - 1;
+        total += chunks[valid].tokens.size();
+    }
+
+    Chunk rest;
+    if (valid < count) lex_chunk(input.substr(bounds[valid]), line, true, rest);
+
+    TokenStream stream;
+    stream.tokens.resize(total + rest.tokens.size(), Token(TokenType::NEWLINE, string_view(), 0, 0));
+    stream.error = std::move(rest.error);
+
+    // every chunk was lexed from line 1, they are shifted while being copied into place
+    auto place = [&](size_t i) {
+        Token* out = stream.tokens.data() + offsets[i];
+        for (Token token : chunks[i].tokens) {
+            token.line += first_lines[i] - 1;
+            *out++ = token;
+        }
+        vector<Token>().swap(chunks[i].tokens);
+    };
+    workers.clear();
+    for (size_t i = 1; i < valid; i++) workers.emplace_back(place, i);
+    if (valid > 0) place(0);
+    copy(rest.tokens.begin(), rest.tokens.end(), stream.tokens.begin() + total);
+    for (auto& worker : workers) worker.join();
+
+    return stream;
+}
+
+void Lexer::lex_chunk(string_view input, unsigned int line, bool last, Chunk& chunk) {
+    Lexer lexer;
+    lexer.init(input, line);
+    // a rough guess of the token density, to avoid most of the regrowth
+    chunk.tokens.reserve(input.length() / 8);
+    try {
+        while (optional<Token> token = lexer.get_next_token()) {
+            chunk.tokens.push_back(token.value());
+        }
+        chunk.clean = last || !lexer.unterminated_comment_;
+    } catch (const runtime_error& e) {
+        // could be a string cut at the chunk's end, the sequential pass decides
+        chunk.error = e.what();
+    }
+    chunk.end_line = lexer.line_;
 }
@@ -1,31 +1,52 @@
 #pragma once
 
-#include <string>
 #include <optional>
-#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include "token.hpp"
 
 using namespace std;
 
-struct Rule {
-    regex pattern;
-    optional<TokenType> token_type;
+// a whole input lexed up front by Lexer::tokenize
+struct TokenStream {
+    vector<Token> tokens;
+    // set when lexing stopped early, tokens holds everything lexed before the error
+    optional<string> error;
 };
 
 class Lexer {
 public:
     Lexer();
-    void init(const string& input);
+    void init(string_view input, unsigned int line = 1, unsigned int column = 1);
     bool has_more_tokens() const;
     bool is_EOF() const;
     optional<Token> get_next_token();
-    optional<string> match(const regex& pattern, const string& str);
+
+    // splits large inputs into chunks lexed on separate threads
+    static TokenStream tokenize(string_view input, unsigned int threads);
 
 private:
-    string input_;
+    string_view input_;
     unsigned int cursor_;
     unsigned int line_;
     unsigned int column_;
-    vector<pair<regex, optional<TokenType>>> spec_;
+    // an unclosed "/*" was lexed as "/" and "*", which is only right if the input really ends here
+    bool unterminated_comment_;
+
+    struct Chunk {
+        vector<Token> tokens;
+        unsigned int end_line = 1;
+        bool clean = false;
+        optional<string> error;
+    };
+    static void lex_chunk(string_view input, unsigned int line, bool last, Chunk& chunk);
+
+    void skip_whitespace_and_comments();
+    Token make_token(TokenType token_type, unsigned int start, unsigned int length);
+    Token scan_number(unsigned int start);
+    Token scan_string(unsigned int start);
+    Token scan_identifier(unsigned int start);
+    optional<TokenType> keyword_type(const char* lexeme, unsigned int length) const;
 };
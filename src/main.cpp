@@ -1,30 +1,22 @@
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
+#include <optional>
 #include <stdexcept>
 
 #include "ast.hpp"
+#include "builder.hpp"
+#include "dump.hpp"
+#include "optimizer.hpp"
 #include "parser.hpp"
+#include "purity.hpp"
 #include "evaluator.hpp"
+#include "closures.hpp"
+#include "vm.hpp"
+#include "source.hpp"
 
 using namespace std;
 
-string read_file(const string& filepath) {
-    if (filepath.substr(filepath.find_last_of(".") + 1) != "sia") {
-        throw runtime_error("File must have .sia extension");
-    }
-
-    ifstream file(filepath);
-    if (!file.is_open()) {
-        throw runtime_error("Could not open file: " + filepath);
-    }
-
-    stringstream buffer;
-    buffer << file.rdbuf();
-    file.close();
-
-    return buffer.str();
-}
-
 void start_repl() {
 
     printf("Sia 0.1 - 2024\n");
@@ -48,30 +40,152 @@ void start_repl() {
     }
 }
 
+struct Options {
+    string filename;
+    // parse every function body up front, so syntax errors are reported before anything runs
+    bool strict = false;
+    // evaluator counters, written to stderr once the program is done
+    bool stats = false;
+    // run on the bytecode VM instead of walking the tree
+    bool vm = false;
+    // run the tree compiled to closures instead of walking it
+    bool closures = false;
+    // compile hot numeric functions and loops of the tree walker to native code
+    bool jit = false;
+    // print the program's bytecode instead of running it
+    bool disassemble = false;
+    // print the optimized tree, and what each optimizer pass did, instead of running it
+    bool dump_ast = false;
+    // rewrite the tree with the optimizer before anything runs it, --no-optimize runs it as parsed
+    bool optimize = true;
+    // let the optimizer replace calls of small functions with their body, --no-inline keeps the calls
+    bool inline_calls = true;
+    // keep the results of calls of pure functions, up to memo_limit bytes, tree walker only
+    bool memoize = false;
+    size_t memo_limit = 8 << 20;
+    // `sia build`: compile the program to an executable instead of running it
+    bool build = false;
+    // the executable built, the script's name without .sia by default
+    string output;
+};
+
+bool parse_options(int argc, char *argv[], Options& options) {
+    for (int i = 1; i < argc; i++) {
+        string argument = argv[i];
+        if (argument == "build" && i == 1) {
+            options.build = true;
+        } else if (argument == "-o" && options.build && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (argument == "--strict") {
+            options.strict = true;
+        } else if (argument == "--stats") {
+            options.stats = true;
+        } else if (argument == "--vm") {
+            options.vm = true;
+        } else if (argument == "--closures") {
+            options.closures = true;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--disassemble") {
+            options.disassemble = true;
+        } else if (argument == "--dump-ast") {
+            options.dump_ast = true;
+        } else if (argument == "--no-optimize") {
+            options.optimize = false;
+        } else if (argument == "--no-inline") {
+            options.inline_calls = false;
+        } else if (argument == "--memoize") {
+            options.memoize = true;
+        } else if (argument == "--memo-limit" && i + 1 < argc) {
+            // in kilobytes, at least one, and few enough that the bytes fit a size_t
+            char* end;
+            const unsigned long long kilobytes = strtoull(argv[++i], &end, 10);
+            if (*end || end == argv[i] || argv[i][0] == '-') return false;
+            if (kilobytes == 0 || kilobytes > (SIZE_MAX >> 10)) return false;
+            options.memo_limit = static_cast<size_t>(kilobytes) << 10;
+        } else if (argument.rfind("--", 0) == 0 || !options.filename.empty()) {
+            return false;
+        } else {
+            options.filename = argument;
+        }
+    }
+    // the other engines call every function
+    return !options.memoize || !(options.vm || options.closures || options.build || options.disassemble);
+}
+
+// the tree walker, the VM and the closure evaluator all take evaluate and print_stats. the optimizer's
+// report comes after the run, calls inlined in bodies parsed on their first call are counted then
+template <typename Engine>
+void run(Engine&& engine, const ProgramNode& program, const Optimizer* optimizer, const Options& options) {
+    try {
+        engine.evaluate(program);
+    } catch (const runtime_error& e) {
+        if (options.stats) engine.print_stats(cerr);
+        if (options.stats && optimizer) optimizer->print_report(cerr);
+        throw;
+    }
+    if (options.stats) engine.print_stats(cerr);
+    if (options.stats && optimizer) optimizer->print_report(cerr);
+}
+
 int main (int argc, char *argv[]) {
 
-    string filename, input;
+    Options options;
+
+    if (!parse_options(argc, argv, options)) {
+        cout << "Usage: sia [--strict] [--stats] [--no-optimize | --no-inline] [--vm | --closures | --jit] [--memoize [--memo-limit <kilobytes>]] [--disassemble | --dump-ast] <filename.sia>" << endl;
+        cout << "       sia build <filename.sia> [-o <executable>]" << endl;
+        return 1;
 
-    if (argc == 2) {
-        filename = argv[1];
+    } else if (!options.filename.empty()) {
+        const string& filename = options.filename;
         if (filename.substr(filename.find_last_of(".") + 1) != "sia") {
             cout << "Invalid file extension" << endl;
             return 1;
         }
         try {
-            input = read_file(filename);
-            Parser parser = Parser();
-            unique_ptr<ProgramNode> program = parser.parse(input);
-            Evaluator evaluator = Evaluator();
-            evaluator.evaluate(*program);
+            // the mapped file stays alive until the program is done evaluating,
+            // pre-parsed function bodies point into it
+            Source source(filename);
+            // the native code of every function is generated up front, so build parses every body,
+            // and so does the dump of the tree, and finding the pure functions
+            Parser parser = Parser(!options.strict && !options.build && !options.dump_ast && !options.memoize);
+            unique_ptr<ProgramNode> program = parser.parse(source.text());
+            optional<Optimizer> optimizer;
+            if (options.optimize) {
+                optimizer.emplace(program->arena, options.inline_calls);
+                optimizer->optimize(*program);
+            }
+            const Optimizer* report = optimizer ? &*optimizer : nullptr;
+            // after the optimizer, calls it inlined don't make their callers impure anymore
+            if (options.memoize) {
+                const size_t pure = Purity().analyze(*program);
+                if (options.stats) cerr << "pure functions: " << pure << endl;
+            }
+            // nothing runs after these, so the report comes right away
+            const bool runs = !options.dump_ast && !options.build && !options.disassemble;
+            if (report && !runs && (options.dump_ast || options.stats)) report->print_report(cerr);
+            if (options.dump_ast) {
+                dump_ast(*program, cout);
+            } else if (options.build) {
+                const string output = options.output.empty() ? filename.substr(0, filename.find_last_of(".")) : options.output;
+                NativeBuilder().build(*program, filename, output);
+            } else if (options.disassemble) {
+                VM().disassemble(*program, cout);
+            } else if (options.vm) {
+                run(VM(), *program, report, options);
+            } else if (options.closures) {
+                run(ClosureEvaluator(), *program, report, options);
+            } else {
+                run(Evaluator(options.jit, options.memoize ? options.memo_limit : 0), *program, report, options);
+            }
         } catch (const runtime_error& e) {
             cerr << " - " << e.what() << endl;
+            // nothing was built, scripts driving the build have to know
+            if (options.build) return 1;
         }
-    } else if (argc > 2) {
-        cout << "Usage: sia <filename.sia>" << endl;
-        return 1;
 
-    } else if (argc < 2) {
+    } else {
         start_repl();
         return 1;
     }
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cstring>
+
+#include "memo.hpp"
+
+using namespace std;
+
+namespace {
+
+// finalizer of splitmix64, every bit of the input reaches every bit of the hash
+uint64_t mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    return h ^ (h >> 31);
+}
+
+}
+
+MemoCache::MemoCache(size_t limit) : limit_(limit), capacity_(0), used_(0), string_bytes_(0) {
+    if (limit / 2 >= sizeof(entry)) {
+        capacity_ = 1;
+        while (capacity_ * 2 * sizeof(entry) <= limit / 2) capacity_ *= 2;
+    }
+}
+
+bool MemoCache::make_key(const FunctionDefNode& function, const Value* slots, const ArenaList<uint32_t>& parameters, key& out) {
+    if (parameters.size() > max_arguments || capacity_ == 0) {
+        stats_.uncached++;
+        return false;
+    }
+    out.function = &function;
+    out.count = static_cast<uint32_t>(parameters.size());
+    uint64_t hash = mix(reinterpret_cast<uintptr_t>(&function));
+    for (size_t i = 0; i < parameters.size(); ++i) {
+        const Value& argument = slots[parameters[i]];
+        uint64_t bits = 0;
+        switch (argument.type()) {
+        case Value::Type::Long: bits = static_cast<uint64_t>(argument.as_long()); break;
+        case Value::Type::Double: { double number = argument.as_double(); memcpy(&bits, &number, sizeof(bits)); break; }
+        case Value::Type::Bool: bits = argument.as_bool() ? 1 : 0; break;
+        case Value::Type::Null: break;
+        default:
+            stats_.uncached++;
+            return false;
+        }
+        out.types[i] = argument.type();
+        out.bits[i] = bits;
+        hash = mix(hash ^ bits ^ (static_cast<uint64_t>(argument.type()) << 56));
+    }
+    out.hash = hash;
+    return true;
+}
+
+const Value* MemoCache::find(const key& call) {
+    if (!entries_.empty()) {
+        const entry& slot = entries_[call.hash & (entries_.size() - 1)];
+        if (slot.call.function && same(slot.call, call)) {
+            stats_.hits++;
+            return &slot.result;
+        }
+    }
+    stats_.misses++;
+    return nullptr;
+}
+
+void MemoCache::insert(const key& call, const Value& result) {
+    if (entries_.empty()) entries_.resize(min(capacity_, initial_entries));
+    // a quarter full, results evict each other often enough that the table is worth growing
+    if (used_ >= entries_.size() / 4 && entries_.size() < capacity_) grow();
+    entry& slot = entries_[call.hash & (entries_.size() - 1)];
+    const size_t replaced = slot.call.function ? string_size(slot.result) : 0;
+    if (string_bytes_ - replaced + string_size(result) > limit_ - capacity_ * sizeof(entry)) {
+        stats_.uncached++;
+        return;
+    }
+    if (slot.call.function) {
+        stats_.evictions++;
+    } else {
+        used_++;
+    }
+    string_bytes_ = string_bytes_ - replaced + string_size(result);
+    slot.call = call;
+    slot.result = result;
+}
+
+// every entry of the old table lands in its own entry of the new one, its index with one more bit
+// of its hash, so growing never evicts
+void MemoCache::grow() {
+    vector<entry> entries(entries_.size() * 2);
+    for (entry& slot : entries_) {
+        if (slot.call.function) entries[slot.call.hash & (entries.size() - 1)] = std::move(slot);
+    }
+    entries_.swap(entries);
+}
+
+bool MemoCache::same(const key& left, const key& right) {
+    if (left.function != right.function || left.count != right.count) return false;
+    for (uint32_t i = 0; i < left.count; ++i) {
+        if (left.types[i] != right.types[i] || left.bits[i] != right.bits[i]) return false;
+    }
+    return true;
+}
+
+void MemoCache::print_stats(ostream& out) const {
+    out << "memo hits: " << stats_.hits << endl;
+    out << "memo misses: " << stats_.misses << endl;
+    out << "memo evictions: " << stats_.evictions << endl;
+    out << "memo uncached calls: " << stats_.uncached << endl;
+    out << "memo entries: " << used_ << " of " << capacity_ << endl;
+    out << "memo bytes: " << (entries_.size() * sizeof(entry) + string_bytes_) << " of " << limit_ << endl;
+}
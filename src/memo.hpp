@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// results of calls of pure functions, by function and arguments. a call's key hashes to one entry
+// of the table, which holds the latest result, and an evicted result is computed again. the table
+// starts small and doubles whenever it is a quarter full, up to the most entries the limit can
+// hold, so the cache never outgrows its limit and takes only the memory the program's calls need
+class MemoCache {
+public:
+    static constexpr size_t max_arguments = 4;
+
+    // arguments are compared by type and bits, 1 and 1.0 are different keys
+    struct key {
+        const FunctionDefNode* function;
+        uint32_t count;
+        Value::Type types[max_arguments];
+        uint64_t bits[max_arguments];
+        uint64_t hash;
+    };
+
+    struct stats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        // calls whose arguments can't make a key, and results whose string didn't fit
+        size_t uncached = 0;
+    };
+
+    // limit is in bytes, half of it for the table, half for the text of the strings kept
+    explicit MemoCache(size_t limit);
+    virtual ~MemoCache() = default;
+
+    // the arguments are in the parameter slots of the callee's reserved scope. false when one isn't
+    // a long, a double, a boolean or null, or there are more than max_arguments
+    bool make_key(const FunctionDefNode& function, const Value* slots, const ArenaList<uint32_t>& parameters, key& out);
+    // null on a miss
+    const Value* find(const key& call);
+    void insert(const key& call, const Value& result);
+
+    void print_stats(ostream& out) const;
+
+private:
+    struct entry {
+        // function is null while the entry is empty
+        key call{};
+        Value result;
+    };
+
+    static constexpr size_t initial_entries = 64;
+
+    size_t limit_;
+    // the most entries the table grows to, a power of two, or 0 when the limit can't even hold one
+    size_t capacity_;
+    size_t used_;
+    size_t string_bytes_;
+    vector<entry> entries_;
+    stats stats_;
+
+    void grow();
+    static bool same(const key& left, const key& right);
+    static size_t string_size(const Value& value) { return value.is_string() ? value.as_string().size() : 0; }
+};
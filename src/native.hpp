@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+#include "environment.hpp"
+#include "runtime.hpp"
+#include "symbols.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// what a program compiled by NativeBuilder runs on. the generated code keeps the tree walker's
+// Runtime and Environment, so operators, scoping and error messages can't drift from it.
+// the symbols, positions and scope layouts of the tree are handed over as static tables
+class NativeProgram {
+public:
+    using code = Value (*)(NativeProgram& program);
+
+    struct function {
+        // null while the function isn't defined
+        const ScopeLayout* layout = nullptr;
+        code body = nullptr;
+    };
+
+    Runtime runtime;
+    Environment environment;
+
+    // lines holds a line and a column per position
+    NativeProgram(const string_view* symbols, size_t symbol_count, const unsigned int* lines, size_t line_count, const ScopeLayout& layout) {
+        // replayed in order, so symbols and positions keep the ids the generated code uses
+        for (size_t i = 0; i < symbol_count; ++i) program_.symbols.intern(symbols[i]);
+        for (size_t i = 0; i < line_count; ++i) program_.lines.add(lines[2 * i], lines[2 * i + 1]);
+        program_.layout = &layout;
+        runtime.attach(program_);
+        functions_.resize(program_.symbols.size());
+        environment.push(layout);
+    }
+    NativeProgram(const NativeProgram&) = delete;
+    NativeProgram& operator=(const NativeProgram&) = delete;
+    virtual ~NativeProgram() = default;
+
+    const Value& read(uint32_t depth, uint32_t slot, Symbol name) {
+        if (depth == 0 && slot != no_slot) {
+            const Value& value = environment.local(slot);
+            if (!value.is_unset()) return value;
+        }
+        const Value* value = environment.find(depth, slot, name);
+        if (!value) throw runtime.undefined_variable(name);
+        return *value;
+    }
+
+    void define(Symbol name, const ScopeLayout& layout, code body) {
+        functions_[name] = { &layout, body };
+    }
+
+    // the function a call refers to, checked against the number of arguments it passes
+    function callee(Symbol name, size_t arguments, uint32_t position) {
+        const function& callee = functions_[name];
+        if (!callee.body) {
+            throw runtime_error(runtime.error_message("Undefined function : " + string(program_.symbols.name(name)), position));
+        }
+        if (arguments != callee.layout->parameters.size()) {
+            throw runtime_error(runtime.error_message("Argument count mismatch", position));
+        }
+        return callee;
+    }
+
+    // runs a function whose arguments are in the scope reserved at base
+    Value invoke(const function& callee, size_t base) {
+        // a return leaves the bare blocks it is nested in without popping them
+        const size_t depth = environment.depth();
+        environment.enter(*callee.layout, base);
+        Value result = callee.body(*this);
+        environment.pop_to(depth);
+        return result;
+    }
+
+    runtime_error block_error(uint32_t position) {
+        return runtime_error(runtime.error_message("Error inside block", position));
+    }
+
+private:
+    ProgramNode program_;
+    // indexed by symbol
+    vector<function> functions_;
+};
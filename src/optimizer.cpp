@@ -0,0 +1,621 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+
+using namespace std;
+
+namespace {
+
+// nodes an inlined call may expand to, arguments read more than once counted every time
+constexpr size_t inline_budget = 32;
+// longer pre-parsed bodies aren't parsed to find out whether they could be inlined
+constexpr size_t inline_source_limit = 256;
+
+bool is_identifier_char(char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+// whether name appears in source as a whole identifier
+bool mentions(string_view source, string_view name) {
+    for (size_t at = source.find(name); at != string_view::npos; at = source.find(name, at + 1)) {
+        const size_t end = at + name.size();
+        if ((at == 0 || !is_identifier_char(source[at - 1])) && (end == source.size() || !is_identifier_char(source[end]))) return true;
+    }
+    return false;
+}
+
+}
+
+Optimizer::Optimizer(Arena& arena, bool inline_calls)
+    : arena_(arena), inline_calls_(inline_calls), program_(nullptr), pass_(fold), blocks_(0) {}
+
+void Optimizer::optimize(ProgramNode& program) {
+    program_ = &program;
+    runtime_.attach(program);
+    if (inline_calls_) find_inlinable(program);
+    for (int i = 0; i < pass_count; ++i) {
+        scopes_.assign(1, program.layout);
+        blocks_ = 0;
+        run(static_cast<pass>(i), program.statements, true);
+    }
+    program.optimized = true;
+}
+
+void Optimizer::optimize_function(const ProgramNode& program, BlockNode& body) {
+    program_ = &program;
+    runtime_.attach(program);
+    for (int i = 0; i < pass_count; ++i) {
+        scopes_.assign(1, body.layout);
+        blocks_ = 1;
+        run(static_cast<pass>(i), body.statements, false);
+    }
+}
+
+void Optimizer::print_report(ostream& out) const {
+    static const char* const names[] = { "inline", "fold", "simplify", "branches", "unreachable" };
+    for (int i = 0; i < pass_count; ++i) {
+        char line[96];
+        snprintf(line, sizeof(line), "pass %-12s %6zu rewrites %10.3f ms", names[i], stats_[i].rewrites, stats_[i].milliseconds);
+        out << line << endl;
+    }
+    // bodies parsed on their first call are optimized on their own, their calls are counted here too
+    if (program_) out << "inlined call sites: " << program_->inlined_calls << endl;
+}
+
+void Optimizer::run(pass current, ArenaList<StatementNode*>& statements, bool top_level) {
+    const auto start = chrono::steady_clock::now();
+    pass_ = current;
+    optimize_statements(statements, top_level);
+    stats_[current].milliseconds += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// nested statements are rewritten first, so the branches spliced into a list are already done
+void Optimizer::optimize_statements(ArenaList<StatementNode*>& statements, bool top_level) {
+    for (const auto& statement : statements) {
+        optimize_statement(*statement);
+    }
+    if (pass_ == branches) {
+        remove_branches(statements, top_level);
+    } else if (pass_ == unreachable) {
+        drop_unreachable(statements);
+    }
+}
+
+void Optimizer::optimize_statement(StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block: {
+        auto& block = static_cast<BlockNode&>(statement);
+        scopes_.push_back(block.layout);
+        blocks_++;
+        optimize_statements(block.statements, false);
+        blocks_--;
+        scopes_.pop_back();
+        break;
+    }
+    case NodeKind::Assignment:
+        optimize_expression(static_cast<AssignmentNode&>(statement).expression);
+        break;
+
+    case NodeKind::Loop: {
+        auto& loop = static_cast<LoopNode&>(statement);
+        optimize_expression(loop.condition);
+        blocks_++;
+        optimize_statements(loop.body->statements, false);
+        blocks_--;
+        break;
+    }
+    case NodeKind::IfElse: {
+        auto& if_else = static_cast<IfElseNode&>(statement);
+        optimize_expression(if_else.condition);
+        blocks_++;
+        optimize_statements(if_else.if_branch->statements, false);
+        if (if_else.else_branch) optimize_statements(if_else.else_branch->statements, false);
+        blocks_--;
+        break;
+    }
+    case NodeKind::FunctionDef: {
+        // pre-parsed bodies are optimized when they get parsed
+        auto& function = static_cast<FunctionDefNode&>(statement);
+        if (!function.body) break;
+        vector<const ScopeLayout*> scopes(1, function.body->layout);
+        swap(scopes, scopes_);
+        const uint32_t blocks = blocks_;
+        blocks_ = 1;
+        optimize_statements(function.body->statements, false);
+        blocks_ = blocks;
+        swap(scopes, scopes_);
+        break;
+    }
+    case NodeKind::ExpressionStatement:
+        optimize_expression(static_cast<ExpressionStatementNode&>(statement).expression);
+        break;
+
+    case NodeKind::Return: {
+        auto& my_return = static_cast<ReturnNode&>(statement);
+        if (my_return.expression) optimize_expression(my_return.expression);
+        // an inlined call is no tail call anymore
+        if (my_return.tail_call && my_return.expression->kind != NodeKind::FunctionCall) my_return.tail_call = false;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// operands first, so a folded operand can fold the operator above it, and a call whose arguments
+// were inlined can be inlined in turn
+void Optimizer::optimize_expression(ExpressionNode*& expression) {
+    if (pass_ != inlining && pass_ != fold && pass_ != simplify) return;
+    switch (expression->kind) {
+    case NodeKind::BinaryOp: {
+        auto binary = static_cast<BinaryOpNode*>(expression);
+        optimize_expression(binary->left);
+        optimize_expression(binary->right);
+        break;
+    }
+    case NodeKind::UnaryOp:
+        optimize_expression(static_cast<UnaryOpNode*>(expression)->operand);
+        break;
+
+    case NodeKind::FunctionCall:
+        for (auto& argument : static_cast<FunctionCallNode*>(expression)->arguments) {
+            optimize_expression(argument);
+        }
+        break;
+
+    default:
+        break;
+    }
+    ExpressionNode* rewritten;
+    if (pass_ == inlining) {
+        rewritten = inline_call(*expression);
+    } else {
+        rewritten = pass_ == fold ? fold_expression(*expression) : simplify_expression(*expression);
+    }
+    if (rewritten) {
+        expression = rewritten;
+        stats_[pass_].rewrites++;
+    }
+}
+
+// a function can be inlined when its body only returns an expression without calls, and nothing but
+// its one top-level definition can define it: every call placed after that definition then runs it.
+// pre-parsed bodies of candidates are parsed here, the engines then use them as well
+void Optimizer::find_inlinable(ProgramNode& program) {
+    unordered_map<Symbol, size_t> definitions;
+    vector<string_view> unparsed;
+    count_definitions(program.statements, definitions, unparsed);
+
+    for (const auto& statement : program.statements) {
+        if (statement->kind != NodeKind::FunctionDef) continue;
+        auto& function = static_cast<FunctionDefNode&>(*statement);
+        // natives are called instead of functions of the same name
+        if (definitions[function.name] != 1 || runtime_.native(function.name)) continue;
+        const string_view name = program.symbols.name(function.name);
+        if (any_of(unparsed.begin(), unparsed.end(), [&](string_view source) { return mentions(source, name); })) continue;
+
+        vector<Symbol> parameters(function.parameters.begin(), function.parameters.end());
+        sort(parameters.begin(), parameters.end());
+        if (adjacent_find(parameters.begin(), parameters.end()) != parameters.end()) continue;
+
+        if (!function.body) {
+            if (function.body_source.size() > inline_source_limit) continue;
+            try {
+                function.body = Parser(true).parse_function_body(function, program, program.arena);
+            } catch (const runtime_error&) {
+                // the syntax error is raised on the first call, as it would have been
+                continue;
+            }
+        }
+        const auto& statements = function.body->statements;
+        if (statements.size() != 1 || statements[0]->kind != NodeKind::Return) continue;
+        const ExpressionNode* returned = static_cast<const ReturnNode*>(statements[0])->expression;
+        if (!returned || has_calls(*returned) || count_nodes(*returned) > inline_budget) continue;
+        program.inlinable[function.name] = &function;
+    }
+}
+
+// pre-parsed bodies are only searched for nested definitions
+void Optimizer::count_definitions(const ArenaList<StatementNode*>& statements, unordered_map<Symbol, size_t>& definitions, vector<string_view>& unparsed) {
+    for (const auto& statement : statements) {
+        switch (statement->kind) {
+        case NodeKind::Block:
+            count_definitions(static_cast<const BlockNode*>(statement)->statements, definitions, unparsed);
+            break;
+
+        case NodeKind::Loop:
+            count_definitions(static_cast<const LoopNode*>(statement)->body->statements, definitions, unparsed);
+            break;
+
+        case NodeKind::IfElse: {
+            auto if_else = static_cast<const IfElseNode*>(statement);
+            count_definitions(if_else->if_branch->statements, definitions, unparsed);
+            if (if_else->else_branch) count_definitions(if_else->else_branch->statements, definitions, unparsed);
+            break;
+        }
+        case NodeKind::FunctionDef: {
+            auto function = static_cast<const FunctionDefNode*>(statement);
+            definitions[function->name]++;
+            if (function->body) {
+                count_definitions(function->body->statements, definitions, unparsed);
+            } else if (mentions(function->body_source, "function")) {
+                unparsed.push_back(function->body_source);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// only inside a block: an error raised in the body is reported at the outermost block around it,
+// which is then the same with or without the call. the arguments have no calls, so they can't
+// print, and expressions can't assign, so one evaluated later or twice gives the same value
+ExpressionNode* Optimizer::inline_call(ExpressionNode& expression) {
+    if (expression.kind != NodeKind::FunctionCall || blocks_ == 0) return nullptr;
+    auto& call = static_cast<FunctionCallNode&>(expression);
+    auto found = program_->inlinable.find(call.name);
+    if (found == program_->inlinable.end()) return nullptr;
+    const FunctionDefNode& function = *found->second;
+    if (call.arguments.size() != function.parameters.size()) return nullptr;
+
+    const LineTable& lines = program_->lines;
+    if (make_pair(lines.line(call.position), lines.column(call.position))
+        <= make_pair(lines.line(function.position), lines.column(function.position))) return nullptr;
+
+    const ExpressionNode& returned = *static_cast<const ReturnNode*>(function.body->statements[0])->expression;
+    size_t size = count_nodes(returned);
+    for (size_t i = 0; i < call.arguments.size(); ++i) {
+        const ExpressionNode& argument = *call.arguments[i];
+        if (has_calls(argument)) return nullptr;
+        size_t reads = 0, unconditional = 0;
+        count_reads(returned, function.parameters[i], false, reads, unconditional);
+        // an argument that can raise an error still has to be evaluated every time
+        if (!is_literal(argument) && unconditional == 0) return nullptr;
+        size += reads * count_nodes(argument) - reads;
+    }
+    if (size > inline_budget) return nullptr;
+
+    vector<bool> used(call.arguments.size(), false);
+    program_->inlined_calls++;
+    return substitute(returned, function, call, used);
+}
+
+// a copy of the body's expression with the arguments in place of the parameters, the first read of
+// each takes the argument itself. the other variables are free in the body, they are looked up
+// along the callers, which now starts at the call site's scopes
+ExpressionNode* Optimizer::substitute(const ExpressionNode& expression, const FunctionDefNode& function, const FunctionCallNode& call, vector<bool>& used) {
+    switch (expression.kind) {
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        for (size_t i = 0; i < function.parameters.size(); ++i) {
+            if (function.parameters[i] != variable.identifier) continue;
+            if (used[i]) return clone(*call.arguments[i]);
+            used[i] = true;
+            return call.arguments[i];
+        }
+        auto free = arena_.make<VariableNode>(variable.identifier, variable.position);
+        Resolver::bind(*free, scopes_);
+        return free;
+    }
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        ExpressionNode* left = substitute(*binary.left, function, call, used);
+        ExpressionNode* right = substitute(*binary.right, function, call, used);
+        return arena_.make<BinaryOpNode>(binary.op, left, right, binary.position);
+    }
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        return arena_.make<UnaryOpNode>(unary.op, substitute(*unary.operand, function, call, used), unary.position);
+    }
+    default:
+        return clone(expression);
+    }
+}
+
+// operators get their own type feedback
+ExpressionNode* Optimizer::clone(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        ExpressionNode* left = clone(*binary.left);
+        ExpressionNode* right = clone(*binary.right);
+        return arena_.make<BinaryOpNode>(binary.op, left, right, binary.position);
+    }
+    case NodeKind::UnaryOp: {
+        auto& unary = static_cast<const UnaryOpNode&>(expression);
+        return arena_.make<UnaryOpNode>(unary.op, clone(*unary.operand), unary.position);
+    }
+    case NodeKind::FunctionCall: {
+        auto& call = static_cast<const FunctionCallNode&>(expression);
+        vector<ExpressionNode*> arguments;
+        for (const auto& argument : call.arguments) {
+            arguments.push_back(clone(*argument));
+        }
+        return arena_.make<FunctionCallNode>(call.name, arena_.make_list<ExpressionNode*>(arguments), call.position);
+    }
+    case NodeKind::Variable:
+        return arena_.make<VariableNode>(static_cast<const VariableNode&>(expression));
+    case NodeKind::StringLiteral:
+        return arena_.make<StringLiteral>(static_cast<const StringLiteral&>(expression));
+    case NodeKind::LongNumberLiteral:
+        return arena_.make<LongNumberLiteral>(static_cast<const LongNumberLiteral&>(expression));
+    case NodeKind::DoubleNumberLiteral:
+        return arena_.make<DoubleNumberLiteral>(static_cast<const DoubleNumberLiteral&>(expression));
+    default:
+        return arena_.make<BoolLiteral>(static_cast<const BoolLiteral&>(expression));
+    }
+}
+
+size_t Optimizer::count_nodes(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        return 1 + count_nodes(*binary.left) + count_nodes(*binary.right);
+    }
+    case NodeKind::UnaryOp:
+        return 1 + count_nodes(*static_cast<const UnaryOpNode&>(expression).operand);
+    case NodeKind::FunctionCall: {
+        size_t count = 1;
+        for (const auto& argument : static_cast<const FunctionCallNode&>(expression).arguments) {
+            count += count_nodes(*argument);
+        }
+        return count;
+    }
+    default:
+        return 1;
+    }
+}
+
+void Optimizer::count_reads(const ExpressionNode& expression, Symbol name, bool conditional, size_t& reads, size_t& unconditional) {
+    switch (expression.kind) {
+    case NodeKind::Variable:
+        if (static_cast<const VariableNode&>(expression).identifier != name) break;
+        reads++;
+        if (!conditional) unconditional++;
+        break;
+
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        count_reads(*binary.left, name, conditional, reads, unconditional);
+        count_reads(*binary.right, name, conditional || Runtime::is_short_circuit(binary.op), reads, unconditional);
+        break;
+    }
+    case NodeKind::UnaryOp:
+        count_reads(*static_cast<const UnaryOpNode&>(expression).operand, name, conditional, reads, unconditional);
+        break;
+
+    case NodeKind::FunctionCall:
+        for (const auto& argument : static_cast<const FunctionCallNode&>(expression).arguments) {
+            count_reads(*argument, name, conditional, reads, unconditional);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+bool Optimizer::has_calls(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        return has_calls(*binary.left) || has_calls(*binary.right);
+    }
+    case NodeKind::UnaryOp:
+        return has_calls(*static_cast<const UnaryOpNode&>(expression).operand);
+    case NodeKind::FunctionCall:
+        return true;
+    default:
+        return false;
+    }
+}
+
+ExpressionNode* Optimizer::fold_expression(ExpressionNode& expression) {
+    try {
+        if (expression.kind == NodeKind::UnaryOp) {
+            auto& unary = static_cast<UnaryOpNode&>(expression);
+            if (!is_literal(*unary.operand)) return nullptr;
+            return make_literal(runtime_.unary_op(unary.op, value_of(*unary.operand), unary.position), unary.position);
+        }
+        if (expression.kind != NodeKind::BinaryOp) return nullptr;
+
+        auto& binary = static_cast<BinaryOpNode&>(expression);
+        if (Runtime::is_short_circuit(binary.op)) {
+            // a left operand that decides drops the right one, which would never run
+            const bool decided = binary.op == TokenType::LOGICAL_OR;
+            bool truth;
+            if (!is_literal(*binary.left) || !truth_of(*binary.left, truth)) return nullptr;
+            if (truth == decided) return arena_.make<BoolLiteral>(decided, binary.position);
+            if (!is_literal(*binary.right) || !truth_of(*binary.right, truth)) return nullptr;
+            return arena_.make<BoolLiteral>(truth, binary.position);
+        }
+        if (!is_literal(*binary.left) || !is_literal(*binary.right)) return nullptr;
+        return make_literal(runtime_.binary_op(binary.op, value_of(*binary.left), value_of(*binary.right), binary.position), binary.position);
+    } catch (const runtime_error&) {
+        return nullptr;
+    }
+}
+
+// only rewrites giving the very same value: x + 0 would turn -0.0 into 0.0 and concatenates strings,
+// so it needs x to be a long
+ExpressionNode* Optimizer::simplify_expression(ExpressionNode& expression) {
+    if (expression.kind != NodeKind::BinaryOp) return nullptr;
+    auto& binary = static_cast<BinaryOpNode&>(expression);
+    const shape left = shape_of(*binary.left), right = shape_of(*binary.right);
+    const bool left_number = left == shape::integer || left == shape::number;
+    const bool right_number = right == shape::integer || right == shape::number;
+
+    switch (binary.op) {
+    case TokenType::PLUS:
+        if (left == shape::integer && is_long(*binary.right, 0)) return binary.left;
+        if (right == shape::integer && is_long(*binary.left, 0)) return binary.right;
+        return nullptr;
+
+    case TokenType::MINUS:
+        return left_number && is_long(*binary.right, 0) ? binary.left : nullptr;
+
+    case TokenType::MULTIPLY:
+        if (left_number && is_long(*binary.right, 1)) return binary.left;
+        if (right_number && is_long(*binary.left, 1)) return binary.right;
+        return nullptr;
+
+    case TokenType::DIVIDE:
+        return left_number && is_long(*binary.right, 1) ? binary.left : nullptr;
+
+    case TokenType::LOGICAL_AND:
+    case TokenType::LOGICAL_OR: {
+        // a literal that doesn't decide leaves the truth of the other operand, which a boolean already is
+        const bool decided = binary.op == TokenType::LOGICAL_OR;
+        bool truth;
+        if (right == shape::boolean && is_literal(*binary.left) && truth_of(*binary.left, truth) && truth != decided) return binary.right;
+        if (left == shape::boolean && is_literal(*binary.right) && truth_of(*binary.right, truth) && truth != decided) return binary.left;
+        return nullptr;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// the live branch of an if is spliced into the enclosing list, they share a scope. at the top level
+// an error inside the branch is reported at the branch, so it stays a block of its own there
+void Optimizer::remove_branches(ArenaList<StatementNode*>& statements, bool top_level) {
+    vector<StatementNode*> kept;
+    bool changed = false;
+    for (const auto& statement : statements) {
+        auto if_else = statement->kind == NodeKind::IfElse ? static_cast<IfElseNode*>(statement) : nullptr;
+        bool truth;
+        if (!if_else || !is_literal(*if_else->condition) || !truth_of(*if_else->condition, truth)
+            || (top_level && truth && !if_else->else_branch)) {
+            kept.push_back(statement);
+            continue;
+        }
+        changed = true;
+        stats_[pass_].rewrites++;
+        BlockNode* live = truth ? if_else->if_branch : if_else->else_branch;
+        if (!live) continue;
+        if (top_level) {
+            if (!truth) if_else->condition = arena_.make<BoolLiteral>(true, if_else->condition->position);
+            if_else->if_branch = live;
+            if_else->else_branch = nullptr;
+            kept.push_back(statement);
+        } else {
+            kept.insert(kept.end(), live->statements.begin(), live->statements.end());
+        }
+    }
+    if (changed) statements = arena_.make_list<StatementNode*>(kept);
+}
+
+void Optimizer::drop_unreachable(ArenaList<StatementNode*>& statements) {
+    for (size_t i = 0; i + 1 < statements.size(); ++i) {
+        if (statements[i]->kind != NodeKind::Return) continue;
+        stats_[pass_].rewrites += statements.size() - i - 1;
+        statements = ArenaList<StatementNode*>(statements.begin(), i + 1);
+        return;
+    }
+}
+
+bool Optimizer::is_literal(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::StringLiteral:
+    case NodeKind::LongNumberLiteral:
+    case NodeKind::DoubleNumberLiteral:
+    case NodeKind::BoolLiteral:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool Optimizer::is_long(const ExpressionNode& expression, long value) {
+    return expression.kind == NodeKind::LongNumberLiteral && static_cast<const LongNumberLiteral&>(expression).value == value;
+}
+
+Optimizer::shape Optimizer::shape_of(const ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::LongNumberLiteral:
+        return shape::integer;
+    case NodeKind::DoubleNumberLiteral:
+        return shape::number;
+    case NodeKind::BoolLiteral:
+        return shape::boolean;
+    case NodeKind::UnaryOp:
+        // -LONG_MIN is a double
+        return shape::number;
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        switch (binary.op) {
+        case TokenType::MODULO:
+            return shape::integer;
+        case TokenType::MINUS:
+        case TokenType::MULTIPLY:
+        case TokenType::DIVIDE:
+            return shape::number;
+        case TokenType::PLUS: {
+            // anything added to a string is concatenated
+            const shape left = shape_of(*binary.left), right = shape_of(*binary.right);
+            const bool numbers = (left == shape::integer || left == shape::number) && (right == shape::integer || right == shape::number);
+            return numbers ? shape::number : shape::unknown;
+        }
+        default:
+            // comparisons, and, or
+            return shape::boolean;
+        }
+    }
+    default:
+        return shape::unknown;
+    }
+}
+
+Value Optimizer::value_of(const ExpressionNode& literal) {
+    switch (literal.kind) {
+    case NodeKind::StringLiteral:
+        return runtime_.string_literal(static_cast<const StringLiteral&>(literal).value);
+    case NodeKind::LongNumberLiteral:
+        return Value(static_cast<const LongNumberLiteral&>(literal).value);
+    case NodeKind::DoubleNumberLiteral:
+        return Value(static_cast<const DoubleNumberLiteral&>(literal).value);
+    default:
+        return Value(static_cast<const BoolLiteral&>(literal).value);
+    }
+}
+
+bool Optimizer::truth_of(const ExpressionNode& literal, bool& truth) {
+    if (literal.kind == NodeKind::StringLiteral) return false;
+    truth = runtime_.to_boolean(value_of(literal), literal.position);
+    return true;
+}
+
+ExpressionNode* Optimizer::make_literal(const Value& value, uint32_t position) {
+    switch (value.type()) {
+    case Value::Type::Long:
+        return arena_.make<LongNumberLiteral>(value.as_long(), position);
+    case Value::Type::Double:
+        // no literal is infinite or NaN
+        if (!isfinite(value.as_double())) return nullptr;
+        return arena_.make<DoubleNumberLiteral>(value.as_double(), position);
+    case Value::Type::Bool:
+        return arena_.make<BoolLiteral>(value.as_bool(), position);
+    case Value::Type::String: {
+        // symbols don't own their text, the folded string is copied next to the nodes
+        const string& text = value.as_string();
+        char* copy = static_cast<char*>(arena_.allocate(text.size() + 1, 1));
+        memcpy(copy, text.data(), text.size());
+        return arena_.make<StringLiteral>(program_->symbols.intern(string_view(copy, text.size())), position);
+    }
+    default:
+        return nullptr;
+    }
+}
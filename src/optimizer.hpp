@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// rewrites resolved trees before any engine runs them, one pass after the other over the whole tree:
+// - inline: calls of small functions are replaced with the expression the function returns, see
+//   find_inlinable for which ones
+// - fold: operators whose operands are literals become the literal they give
+// - simplify: x - 0, x * 1, x / 1 and x + 0 when x is known to give a number that stays the same,
+//   and and/or next to a literal that doesn't decide them
+// - branches: an if whose condition is a literal keeps only the branch that runs
+// - unreachable: statements after a return are dropped
+// an operator that would raise an error is left in place, so the error is still raised when it runs.
+// layouts aren't touched, a slot whose assignments were all removed just stays unset
+class Optimizer {
+public:
+    // rewritten nodes and the text of folded strings are allocated in the given arena
+    explicit Optimizer(Arena& arena, bool inline_calls = true);
+    void optimize(ProgramNode& program);
+    // a body parsed on its first call, once the program it belongs to was optimized
+    void optimize_function(const ProgramNode& program, BlockNode& body);
+    // rewrites and time of each pass
+    void print_report(ostream& out) const;
+    virtual ~Optimizer() = default;
+
+private:
+    enum pass { inlining, fold, simplify, branches, unreachable, pass_count };
+
+    struct pass_stats {
+        size_t rewrites = 0;
+        double milliseconds = 0;
+    };
+
+    // what an expression gives when it doesn't raise an error. integer is a long that can't
+    // overflow to a double, number any long or double
+    enum class shape { unknown, integer, number, boolean };
+
+    Arena& arena_;
+    bool inline_calls_;
+    // evaluates the operators that get folded
+    Runtime runtime_;
+    const ProgramNode* program_;
+    pass pass_;
+    array<pass_stats, pass_count> stats_;
+    // layouts of the scopes around the current node, innermost last, up to the function body, and
+    // how many blocks are around it there
+    vector<const ScopeLayout*> scopes_;
+    uint32_t blocks_;
+
+    void run(pass current, ArenaList<StatementNode*>& statements, bool top_level);
+    void optimize_statements(ArenaList<StatementNode*>& statements, bool top_level);
+    void optimize_statement(StatementNode& statement);
+    void optimize_expression(ExpressionNode*& expression);
+
+    void find_inlinable(ProgramNode& program);
+    void count_definitions(const ArenaList<StatementNode*>& statements, unordered_map<Symbol, size_t>& definitions, vector<string_view>& unparsed);
+    ExpressionNode* inline_call(ExpressionNode& expression);
+    ExpressionNode* substitute(const ExpressionNode& expression, const FunctionDefNode& function, const FunctionCallNode& call, vector<bool>& used);
+    ExpressionNode* clone(const ExpressionNode& expression);
+    static size_t count_nodes(const ExpressionNode& expression);
+    // reads of a parameter, and those that run whenever the expression does, not only when and/or
+    // gets to its right operand
+    static void count_reads(const ExpressionNode& expression, Symbol name, bool conditional, size_t& reads, size_t& unconditional);
+    static bool has_calls(const ExpressionNode& expression);
+
+    ExpressionNode* fold_expression(ExpressionNode& expression);
+    ExpressionNode* simplify_expression(ExpressionNode& expression);
+    void remove_branches(ArenaList<StatementNode*>& statements, bool top_level);
+    void drop_unreachable(ArenaList<StatementNode*>& statements);
+
+    static bool is_literal(const ExpressionNode& expression);
+    static bool is_long(const ExpressionNode& expression, long value);
+    static shape shape_of(const ExpressionNode& expression);
+    Value value_of(const ExpressionNode& literal);
+    // false when the literal is neither a boolean nor a number
+    bool truth_of(const ExpressionNode& literal, bool& truth);
+    // null for values the parser has no literal for
+    ExpressionNode* make_literal(const Value& value, uint32_t position);
+};
@@ -1,37 +1,93 @@
+#include <charconv>
+#include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "ast.hpp"
 #include "parser.hpp"
+#include "resolver.hpp"
 #include "token.hpp"
 
 
 using namespace std;
 
-Parser::Parser() {}
+// below this size a single lexing pass is faster than starting threads
+static const size_t parallel_lexing_threshold = 1 << 20;
 
-unique_ptr<ProgramNode> Parser::parse(const string& input) {
-    input_ = input;
-    lexer_.init(input);
-    look_ahead_ = lexer_.get_next_token();
-    return parse_program();
+Parser::Parser(bool lazy_bodies) : lazy_bodies_(lazy_bodies), pre_tokenized_(false), position_(0), arena_(nullptr), symbols_(nullptr), lines_(nullptr) {}
+
+unique_ptr<ProgramNode> Parser::parse(string_view input) {
+    unsigned int threads = thread::hardware_concurrency();
+    pre_tokenized_ = input.length() >= parallel_lexing_threshold && threads > 1;
+    if (pre_tokenized_) {
+        stream_ = Lexer::tokenize(input, threads);
+        position_ = 0;
+    } else {
+        lexer_.init(input);
+    }
+    look_ahead_ = next_token();
+    auto program = make_unique<ProgramNode>();
+    arena_ = &program->arena;
+    symbols_ = &program->symbols;
+    lines_ = &program->lines;
+    parse_program(*program);
+    stream_ = TokenStream();
+    Resolver(program->arena).resolve(*program);
+    return program;
 }
 
+// the body was brace-matched by the first pass, lexing starts again right at its "{"
+BlockNode* Parser::parse_function_body(const FunctionDefNode& function, const ProgramNode& program, Arena& arena) {
+    arena_ = &arena;
+    symbols_ = &program.symbols;
+    lines_ = &program.lines;
+    pre_tokenized_ = false;
+    lexer_.init(function.body_source, function.body_line, function.body_column);
+    look_ahead_ = next_token();
+    BlockNode* body = parse_block();
+    Resolver(arena).resolve_function(function.parameters, *body);
+    return body;
+}
+
+optional<Token> Parser::next_token() {
+    if (!pre_tokenized_) return lexer_.get_next_token();
+    if (position_ < stream_.tokens.size()) return stream_.tokens[position_++];
+    // lexing errors show up at the same point they would have when lexing lazily
+    if (stream_.error) throw runtime_error(stream_.error.value());
+    return nullopt;
+}
+
+Symbol Parser::symbol(const Token& token) {
+    return symbols_->intern(token.lexeme);
+}
+
+uint32_t Parser::position(const Token& token) {
+    return lines_->add(token.line, token.column);
+}
+
+// moves the nodes pushed since mark into an arena list
+template <typename T>
+ArenaList<T> Parser::end_list(size_t mark) {
+    ArenaList<T> list = arena_->make_list<T>(nodes_, mark);
+    nodes_.resize(mark);
+    return list;
+}
 
-unique_ptr<ProgramNode> Parser::parse_program() {
-    auto program = make_unique<ProgramNode>();
 
+void Parser::parse_program(ProgramNode& program) {
+    const size_t mark = nodes_.size();
     while (look_ahead_.has_value()) {
-        program->statements.push_back(parse_statement());
+        nodes_.push_back(parse_statement());
     }
-
-    return program;
+    program.statements = end_list<StatementNode*>(mark);
 }
 
 
-unique_ptr<StatementNode> Parser::parse_statement() {
+StatementNode* Parser::parse_statement() {
     switch (look_ahead_->type) {
         case TokenType::FUNCTION : return parse_function_def();
         case TokenType::LOOP : return parse_loop();
@@ -43,19 +99,19 @@ unique_ptr<StatementNode> Parser::parse_statement() {
     }
 }
 
-unique_ptr<ReturnNode> Parser::parse_return() {
+ReturnNode* Parser::parse_return() {
     Token token = eat(TokenType::RETURN);
     if (!match(TokenType::SEMICOLON)) {
         auto expression = parse_expression();
         eat(TokenType::SEMICOLON);
-        return make_unique<ReturnNode>(std::move(expression), token.line, token.column);
+        return arena_->make<ReturnNode>(expression, position(token));
     }
     eat(TokenType::SEMICOLON);
-    return make_unique<ReturnNode>(std::move(nullptr), token.line, token.column);
+    return arena_->make<ReturnNode>(nullptr, position(token));
 }
 
-unique_ptr<LoopNode> Parser::parse_loop() {
-    unique_ptr<ExpressionNode> condition;
+LoopNode* Parser::parse_loop() {
+    ExpressionNode* condition = nullptr;
     Token loop = eat(TokenType::LOOP);
     eat(TokenType::LEFT_PAREN);
     // TODO : handle loop without an argument
@@ -64,88 +120,94 @@ unique_ptr<LoopNode> Parser::parse_loop() {
     }
     eat(TokenType::RIGHT_PAREN);
     auto body = parse_block();
-    return make_unique<LoopNode>(std::move(condition), std::move(body), loop.line, loop.column);
+    return arena_->make<LoopNode>(condition, body, position(loop));
 }
 
-unique_ptr<StatementNode> Parser::parse_identifier() {
+StatementNode* Parser::parse_identifier() {
     Token identifier = eat(TokenType::IDENTIFIER);
+    if (!look_ahead_.has_value()) {
+        throw runtime_error("Unexpected end of input - expected: ASSIGN");
+    }
     switch (look_ahead_->type) {
         case TokenType::LEFT_PAREN : {
             auto function_call = parse_function_call(identifier);
             if (match(TokenType::SEMICOLON)) eat(TokenType::SEMICOLON);
-            return make_unique<ExpressionStatementNode>(std::move(function_call), identifier.line, identifier.column);
+            return arena_->make<ExpressionStatementNode>(function_call, position(identifier));
         }
         case TokenType::ASSIGN : return parse_assignment(identifier);
         default: throw runtime_error("Unexpected token: " + token_type_to_string(look_ahead_->type) + " at (" + to_string(look_ahead_->line) + ", " + to_string(look_ahead_->column) + ")");
     }
 }
 
-unique_ptr<StatementNode> Parser::parse_assignment(Token& identifier) {
+StatementNode* Parser::parse_assignment(Token& identifier) {
     eat(TokenType::ASSIGN);
     auto expression = parse_expression();
     eat(TokenType::SEMICOLON);
-    return make_unique<AssignmentNode>(identifier.lexeme, std::move(expression), identifier.line, identifier.column);
+    return arena_->make<AssignmentNode>(symbol(identifier), expression, position(identifier));
 }
 
 
-unique_ptr<ExpressionNode> Parser::parse_expression() {
+ExpressionNode* Parser::parse_expression() {
     // starting from lowest precedence
     return parse_logical_or();
 }
 
-unique_ptr<ExpressionNode> Parser::parse_logical_or() {
+ExpressionNode* Parser::parse_logical_or() {
     auto left = parse_logical_and();
     while (match(TokenType::LOGICAL_OR)) {
         Token op = look_ahead_.value(); eat(op.type);
         auto right = parse_logical_and();
-        left = make_unique<BinaryOpNode>(op.type, std::move(left), std::move(right), op.line, op.column);
+        left = arena_->make<BinaryOpNode>(op.type, left, right, position(op));
     }
     return left;
 }
 
-unique_ptr<ExpressionNode> Parser::parse_logical_and() {
+ExpressionNode* Parser::parse_logical_and() {
     auto left = parse_comparison();
     while (match(TokenType::LOGICAL_AND)) {
         Token op = look_ahead_.value(); eat(op.type);
         auto right = parse_comparison();
-        left = make_unique<BinaryOpNode>(op.type, std::move(left), std::move(right), op.line, op.column);
+        left = arena_->make<BinaryOpNode>(op.type, left, right, position(op));
     }
     return left;
 }
 
-unique_ptr<ExpressionNode> Parser::parse_comparison() {
+ExpressionNode* Parser::parse_comparison() {
     auto left = parse_term();
     while ( match(TokenType::LESS_THAN) || match(TokenType::GREATER_THAN) ||
             match(TokenType::LESS_EQUAL) || match(TokenType::GREATER_EQUAL) ||
             match(TokenType::EQUAL) || match(TokenType::NOT_EQUAL) ) {
         Token op = look_ahead_.value(); eat(op.type);
         auto right = parse_term();
-        left = make_unique<BinaryOpNode>(op.type, std::move(left), std::move(right), op.line, op.column);
+        left = arena_->make<BinaryOpNode>(op.type, left, right, position(op));
     }
     return left;
 }
 
-unique_ptr<ExpressionNode> Parser::parse_term() {
+ExpressionNode* Parser::parse_term() {
     auto left = parse_factor();
     while (match(TokenType::PLUS) || match(TokenType::MINUS)) {
         Token op = look_ahead_.value(); eat(op.type);
         auto right = parse_factor();
-        left = make_unique<BinaryOpNode>(op.type, std::move(left), std::move(right), op.line, op.column);
+        left = arena_->make<BinaryOpNode>(op.type, left, right, position(op));
     }
     return left;
 }
 
-unique_ptr<ExpressionNode> Parser::parse_factor() {
+ExpressionNode* Parser::parse_factor() {
     auto left = parse_primary();
     while (match(TokenType::MULTIPLY) || match(TokenType::DIVIDE) || match(TokenType::MODULO)) {
         Token op = look_ahead_.value(); eat(op.type);
         auto right = parse_primary();
-        left = make_unique<BinaryOpNode>(op.type, std::move(left), std::move(right), op.line, op.column);
+        left = arena_->make<BinaryOpNode>(op.type, left, right, position(op));
     }
     return left;
 }
 
-unique_ptr<ExpressionNode> Parser::parse_primary() {
+ExpressionNode* Parser::parse_primary() {
+    if (!look_ahead_.has_value()) {
+        throw runtime_error("Unexpected end of input - expected: expression");
+    }
     switch (look_ahead_->type) {
         case TokenType::LEFT_PAREN : {
             eat(TokenType::LEFT_PAREN);
@@ -155,82 +217,110 @@ unique_ptr<ExpressionNode> Parser::parse_primary() {
         }
         case TokenType::TRUE : {
             Token token = eat(TokenType::TRUE);
-            return make_unique<BoolLiteral>(true, token.line, token.column);
+            return arena_->make<BoolLiteral>(true, position(token));
         }
         case TokenType::FALSE : {
             Token token = eat(TokenType::FALSE);
-            return make_unique<BoolLiteral>(false, token.line, token.column);
+            return arena_->make<BoolLiteral>(false, position(token));
         }
         case TokenType::STRING : {
             Token string = eat(TokenType::STRING);
-            return make_unique<StringLiteral>(string.lexeme, string.line, string.column);
+            return arena_->make<StringLiteral>(symbol(string), position(string));
         }
         case TokenType::NUMBER : {
             Token number = eat(TokenType::NUMBER);
-            if (is_integer(number.lexeme)) return make_unique<LongNumberLiteral>(stol(number.lexeme), number.line, number.column);
-            return make_unique<DoubleNumberLiteral>(stod(number.lexeme), number.line, number.column);
+            if (is_integer(number.lexeme)) return arena_->make<LongNumberLiteral>(parse_long(number), position(number));
+            return arena_->make<DoubleNumberLiteral>(parse_double(number), position(number));
         }
         case TokenType::MINUS : {
             Token op = eat(TokenType::MINUS);
             auto expression = parse_primary();
-            return make_unique<UnaryOpNode>(op.type, std::move(expression), op.line, op.column);
+            return arena_->make<UnaryOpNode>(op.type, expression, position(op));
         }
         case TokenType::IDENTIFIER : {
             Token identifier = eat(TokenType::IDENTIFIER);
             if (match(TokenType::LEFT_PAREN)) return parse_function_call(identifier);
-            return make_unique<VariableNode>(identifier.lexeme, identifier.line, identifier.column);
+            return arena_->make<VariableNode>(symbol(identifier), position(identifier));
         }
         default: throw runtime_error("Unexpected primary token: " + token_type_to_string(look_ahead_->type) + " at " + to_string(look_ahead_->line) + ", " + to_string(look_ahead_->column));
     }
 }
 
 
-unique_ptr<FunctionDefNode> Parser::parse_function_def() {
+FunctionDefNode* Parser::parse_function_def() {
     eat(TokenType::FUNCTION);
     Token name = eat(TokenType::IDENTIFIER);
-    vector<string> parameters;
     eat(TokenType::LEFT_PAREN);
     if (!match(TokenType::RIGHT_PAREN)) {
         Token parameter = eat(TokenType::IDENTIFIER);
-        parameters.push_back(parameter.lexeme);
+        names_.push_back(symbol(parameter));
         while (match(TokenType::COMMA)) {
             eat(TokenType::COMMA);
             Token parameter = eat(TokenType::IDENTIFIER);
-            parameters.push_back(parameter.lexeme);
+            names_.push_back(symbol(parameter));
         }
     }
     eat(TokenType::RIGHT_PAREN);
+    ArenaList<Symbol> parameters = arena_->make_list<Symbol>(names_);
+    names_.clear();
+
+    if (lazy_bodies_) {
+        const unsigned int line = look_ahead_.has_value() ? look_ahead_->line : 0;
+        const unsigned int column = look_ahead_.has_value() ? look_ahead_->column : 0;
+        auto function = arena_->make<FunctionDefNode>(symbol(name), parameters, nullptr, position(name));
+        function->body_source = skip_block();
+        // the lexer reports the column after a token, so resume right before the "{"
+        function->body_line = line;
+        function->body_column = column - 1;
+        return function;
+    }
+
     auto body = parse_block();
-    return make_unique<FunctionDefNode>(std::move(name.lexeme), std::move(parameters), std::move(body), name.line, name.column);
+    return arena_->make<FunctionDefNode>(symbol(name), parameters, body, position(name));
 }
 
-unique_ptr<FunctionCallNode> Parser::parse_function_call(Token& name) {
-    vector<unique_ptr<ExpressionNode>> arguments;
+FunctionCallNode* Parser::parse_function_call(Token& name) {
+    const size_t mark = nodes_.size();
     eat(TokenType::LEFT_PAREN);
     if (!match(TokenType::RIGHT_PAREN)) {
-        arguments.push_back(parse_expression());
+        nodes_.push_back(parse_expression());
         while (match(TokenType::COMMA)) {
             eat(TokenType::COMMA);
-            arguments.push_back(parse_expression());
+            nodes_.push_back(parse_expression());
         }
     }
     eat(TokenType::RIGHT_PAREN);
     // eat(TokenType::SEMICOLON);
-    return make_unique<FunctionCallNode>(std::move(name.lexeme), std::move(arguments), name.line, name.column);
+    return arena_->make<FunctionCallNode>(symbol(name), end_list<ExpressionNode*>(mark), position(name));
 }
 
-unique_ptr<BlockNode> Parser::parse_block() {
-    vector<unique_ptr<StatementNode>> statements;
+BlockNode* Parser::parse_block() {
+    const size_t mark = nodes_.size();
     Token brace = eat(TokenType::LEFT_BRACE);
     while (!match(TokenType::RIGHT_BRACE)) {
-        statements.push_back(parse_statement());
+        nodes_.push_back(parse_statement());
     }
     eat(TokenType::RIGHT_BRACE);
-    return make_unique<BlockNode>(std::move(statements), brace.line, brace.column);
+    return arena_->make<BlockNode>(end_list<StatementNode*>(mark), position(brace));
+}
+
+
+// eats a balanced "{ ... }" without building anything and returns its source text
+string_view Parser::skip_block() {
+    Token open = eat(TokenType::LEFT_BRACE);
+    Token close = open;
+    unsigned int depth = 1;
+    while (depth > 0) {
+        if (!look_ahead_.has_value()) eat(TokenType::RIGHT_BRACE);
+        if (match(TokenType::LEFT_BRACE)) depth++;
+        if (match(TokenType::RIGHT_BRACE)) depth--;
+        close = eat(look_ahead_->type);
+    }
+    return string_view(open.lexeme.data(), close.lexeme.data() + close.lexeme.length() - open.lexeme.data());
 }
 
-unique_ptr<IfElseNode> Parser::parse_if_else() {
-    unique_ptr<ExpressionNode> condition;
+IfElseNode* Parser::parse_if_else() {
+    ExpressionNode* condition = nullptr;
     Token if_token = eat(TokenType::IF);
     eat(TokenType::LEFT_PAREN);
     // TODO : handle if statement without an argument
@@ -239,18 +329,19 @@ unique_ptr<IfElseNode> Parser::parse_if_else() {
     }
     eat(TokenType::RIGHT_PAREN);
     auto if_branch = parse_block();
-    unique_ptr<BlockNode> else_branch = nullptr;
+    BlockNode* else_branch = nullptr;
     if (match(TokenType::ELSE)) {
         eat(TokenType::ELSE);
         if (match(TokenType::IF)) {
             auto nested_if = parse_if_else();
-            else_branch = make_unique<BlockNode>(vector<unique_ptr<StatementNode>>(), nested_if->line, nested_if->column);
-            else_branch->statements.push_back(std::move(nested_if));
+            const size_t mark = nodes_.size();
+            nodes_.push_back(nested_if);
+            else_branch = arena_->make<BlockNode>(end_list<StatementNode*>(mark), nested_if->position);
         } else {
             else_branch = parse_block();
         }
     }
-    return make_unique<IfElseNode>(std::move(condition), std::move(if_branch), std::move(else_branch), if_token.line, if_token.column);
+    return arena_->make<IfElseNode>(condition, if_branch, else_branch, position(if_token));
 }
 
 string Parser::token_type_to_string(const TokenType& token_type) {
@@ -288,18 +379,37 @@ Token Parser::eat(const TokenType& token_type) {
     }
 
     Token token = look_ahead_.value();
-    look_ahead_ = lexer_.get_next_token();
+    look_ahead_ = next_token();
     return token;
 }
 
 bool Parser::match(const TokenType& token_type) {
-    return look_ahead_->type == token_type;
+    return look_ahead_.has_value() && look_ahead_->type == token_type;
 }
 
-bool Parser::is_integer(const string& lexeme) {
-    if (lexeme.find('.') != string::npos) {
+bool Parser::is_integer(string_view lexeme) {
+    if (lexeme.find('.') != string_view::npos) {
         return false;
     }
     return true;
 }
 
+// numbers are converted straight from the source buffer, without a temporary string
+long Parser::parse_long(const Token& number) {
+    long value = 0;
+    auto [end, error] = from_chars(number.lexeme.data(), number.lexeme.data() + number.lexeme.size(), value);
+    if (error != errc() || end != number.lexeme.data() + number.lexeme.size()) {
+        throw runtime_error("Invalid integer: " + string(number.lexeme) + " at " + to_string(number.line) + ", " + to_string(number.column));
+    }
+    return value;
+}
+
+double Parser::parse_double(const Token& number) {
+    double value = 0;
+    auto [end, error] = from_chars(number.lexeme.data(), number.lexeme.data() + number.lexeme.size(), value);
+    if (error != errc() || end != number.lexeme.data() + number.lexeme.size()) {
+        throw runtime_error("Invalid number: " + string(number.lexeme) + " at " + to_string(number.line) + ", " + to_string(number.column));
+    }
+    return value;
+}
+
@@ -2,7 +2,9 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <optional>
+#include <vector>
 #include "ast.hpp"
 #include "lexer.hpp"
 
@@ -10,37 +12,62 @@ using namespace std;
 
 class Parser {
 public:
-    Parser();
-    unique_ptr<ProgramNode> parse(const string& input);
+    // with lazy_bodies, function bodies are only brace-matched until they are first called
+    explicit Parser(bool lazy_bodies = false);
+    // trees, and bodies parsed later on, come back with their variables resolved to slots
+    unique_ptr<ProgramNode> parse(string_view input);
+    // the body is allocated in the given arena, which must outlive it, and shares the program's tables
+    BlockNode* parse_function_body(const FunctionDefNode& function, const ProgramNode& program, Arena& arena);
     virtual ~Parser() = default;
 
 private:
-    string input_;
+    bool lazy_bodies_;
     Lexer lexer_;
     optional<Token> look_ahead_;
+    // large inputs are lexed up front in parallel, tokens are then read from here
+    bool pre_tokenized_;
+    TokenStream stream_;
+    size_t position_;
 
-    unique_ptr<ProgramNode> parse_program();
-
-    unique_ptr<StatementNode> parse_statement();
-    unique_ptr<StatementNode> parse_identifier();
-    unique_ptr<StatementNode> parse_assignment(Token& identifier);
-    unique_ptr<LoopNode> parse_loop();
-    unique_ptr<FunctionCallNode> parse_function_call(Token& identifier);
-    unique_ptr<ReturnNode> parse_return();
-    unique_ptr<FunctionDefNode> parse_function_def();
-    unique_ptr<BlockNode> parse_block();
-    unique_ptr<IfElseNode> parse_if_else();
-
-    unique_ptr<ExpressionNode> parse_expression();
-    unique_ptr<ExpressionNode> parse_logical_or();
-    unique_ptr<ExpressionNode> parse_logical_and();
-    unique_ptr<ExpressionNode> parse_comparison();
-    unique_ptr<ExpressionNode> parse_term();
-    unique_ptr<ExpressionNode> parse_factor();
-    unique_ptr<ExpressionNode> parse_primary();
+    optional<Token> next_token();
+
+    Arena* arena_;
+    SymbolTable* symbols_;
+    LineTable* lines_;
+    // child nodes of everything being parsed, each list is moved into the arena once complete
+    vector<ASTNode*> nodes_;
+    vector<Symbol> names_;
+
+    Symbol symbol(const Token& token);
+    uint32_t position(const Token& token);
+    template <typename T>
+    ArenaList<T> end_list(size_t mark);
+
+    void parse_program(ProgramNode& program);
+
+    StatementNode* parse_statement();
+    StatementNode* parse_identifier();
+    StatementNode* parse_assignment(Token& identifier);
+    LoopNode* parse_loop();
+    FunctionCallNode* parse_function_call(Token& identifier);
+    ReturnNode* parse_return();
+    FunctionDefNode* parse_function_def();
+    BlockNode* parse_block();
+    string_view skip_block();
+    IfElseNode* parse_if_else();
+
+    ExpressionNode* parse_expression();
+    ExpressionNode* parse_logical_or();
+    ExpressionNode* parse_logical_and();
+    ExpressionNode* parse_comparison();
+    ExpressionNode* parse_term();
+    ExpressionNode* parse_factor();
+    ExpressionNode* parse_primary();
 
     Token eat(const TokenType& token_type);
     bool match(const TokenType& token_type);
-    bool is_integer(const string& lexeme);
+    bool is_integer(string_view lexeme);
+    long parse_long(const Token& number);
+    double parse_double(const Token& number);
     string token_type_to_string(const TokenType& token_type);
 };
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <vector>
+
+#include "purity.hpp"
+
+using namespace std;
+
+// every function starts out pure, those that call one found impure are then dropped until none
+// is, so functions calling each other stay pure unless one of them does something else
+size_t Purity::analyze(ProgramNode& program) {
+    runtime_.attach(program);
+    functions_.clear();
+    definitions_.clear();
+    collect(program.statements);
+
+    for (auto function : functions_) function->pure = function->body != nullptr;
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (auto function : functions_) {
+            if (!function->pure) continue;
+            vector<Symbol> assigned(function->parameters.begin(), function->parameters.end());
+            if (!pure_statements(function->body->statements, assigned)) {
+                function->pure = false;
+                changed = true;
+            }
+        }
+    }
+    return count_if(functions_.begin(), functions_.end(), [](const FunctionDefNode* function) { return function->pure; });
+}
+
+void Purity::collect(const ArenaList<StatementNode*>& statements) {
+    for (const auto& statement : statements) {
+        switch (statement->kind) {
+        case NodeKind::Block:
+            collect(static_cast<const BlockNode*>(statement)->statements);
+            break;
+
+        case NodeKind::Loop:
+            collect(static_cast<const LoopNode*>(statement)->body->statements);
+            break;
+
+        case NodeKind::IfElse: {
+            auto if_else = static_cast<const IfElseNode*>(statement);
+            collect(if_else->if_branch->statements);
+            if (if_else->else_branch) collect(if_else->else_branch->statements);
+            break;
+        }
+        case NodeKind::FunctionDef: {
+            auto function = static_cast<FunctionDefNode*>(statement);
+            functions_.push_back(function);
+            definitions_[function->name].push_back(function);
+            if (function->body) collect(function->body->statements);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+// if and loop bodies may not run, what they assign is only known to be set inside them. a bare
+// block's variables are gone after it
+bool Purity::pure_statements(const ArenaList<StatementNode*>& statements, vector<Symbol>& assigned) const {
+    for (const auto& statement : statements) {
+        switch (statement->kind) {
+        case NodeKind::Block: {
+            vector<Symbol> inner = assigned;
+            if (!pure_statements(static_cast<const BlockNode*>(statement)->statements, inner)) return false;
+            break;
+        }
+        case NodeKind::Assignment: {
+            auto assignment = static_cast<const AssignmentNode*>(statement);
+            if (!pure_expression(*assignment->expression, assigned)) return false;
+            assigned.push_back(assignment->identifier);
+            break;
+        }
+        case NodeKind::Loop: {
+            auto loop = static_cast<const LoopNode*>(statement);
+            vector<Symbol> inner = assigned;
+            if (!pure_expression(*loop->condition, assigned) || !pure_statements(loop->body->statements, inner)) return false;
+            break;
+        }
+        case NodeKind::IfElse: {
+            auto if_else = static_cast<const IfElseNode*>(statement);
+            if (!pure_expression(*if_else->condition, assigned)) return false;
+            vector<Symbol> inner = assigned;
+            if (!pure_statements(if_else->if_branch->statements, inner)) return false;
+            inner = assigned;
+            if (if_else->else_branch && !pure_statements(if_else->else_branch->statements, inner)) return false;
+            break;
+        }
+        case NodeKind::ExpressionStatement:
+            if (!pure_expression(*static_cast<const ExpressionStatementNode*>(statement)->expression, assigned)) return false;
+            break;
+
+        case NodeKind::Return: {
+            auto my_return = static_cast<const ReturnNode*>(statement);
+            if (my_return->expression && !pure_expression(*my_return->expression, assigned)) return false;
+            break;
+        }
+        default:
+            // a definition changes which function a name calls
+            return false;
+        }
+    }
+    return true;
+}
+
+// a variable not surely assigned could be read from a caller's scope
+bool Purity::pure_expression(const ExpressionNode& expression, const vector<Symbol>& assigned) const {
+    switch (expression.kind) {
+    case NodeKind::Variable: {
+        auto& variable = static_cast<const VariableNode&>(expression);
+        return variable.slot != no_slot && find(assigned.begin(), assigned.end(), variable.identifier) != assigned.end();
+    }
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<const BinaryOpNode&>(expression);
+        return pure_expression(*binary.left, assigned) && pure_expression(*binary.right, assigned);
+    }
+    case NodeKind::UnaryOp:
+        return pure_expression(*static_cast<const UnaryOpNode&>(expression).operand, assigned);
+
+    case NodeKind::FunctionCall:
+        return pure_call(static_cast<const FunctionCallNode&>(expression), assigned);
+
+    default:
+        return true;
+    }
+}
+
+// natives are called instead of functions of the same name
+bool Purity::pure_call(const FunctionCallNode& call, const vector<Symbol>& assigned) const {
+    for (const auto& argument : call.arguments) {
+        if (!pure_expression(*argument, assigned)) return false;
+    }
+    if (runtime_.native(call.name)) return runtime_.pure_native(call.name);
+    auto found = definitions_.find(call.name);
+    return found != definitions_.end() && found->second.size() == 1 && found->second.front()->pure;
+}
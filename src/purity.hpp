@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "runtime.hpp"
+#include "symbols.hpp"
+
+using namespace std;
+
+// marks the functions whose result only depends on their arguments, see FunctionDefNode::pure.
+// such a function reads its parameters and the variables it assigned itself before, defines no
+// function and only calls pure natives and pure functions defined once. assignments always write
+// the innermost scope, so it can't change anything its callers see either.
+// runs on a program whose bodies were all parsed, the unparsed ones are never pure
+class Purity {
+public:
+    Purity() = default;
+    // returns how many functions are pure
+    size_t analyze(ProgramNode& program);
+    virtual ~Purity() = default;
+
+private:
+    // knows the natives
+    Runtime runtime_;
+    vector<FunctionDefNode*> functions_;
+    unordered_map<Symbol, vector<const FunctionDefNode*>> definitions_;
+
+    void collect(const ArenaList<StatementNode*>& statements);
+    // assigned holds the variables a statement can read, they grow in straight-line code only
+    bool pure_statements(const ArenaList<StatementNode*>& statements, vector<Symbol>& assigned) const;
+    bool pure_expression(const ExpressionNode& expression, const vector<Symbol>& assigned) const;
+    bool pure_call(const FunctionCallNode& call, const vector<Symbol>& assigned) const;
+};
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <vector>
+
+#include "resolver.hpp"
+
+using namespace std;
+
+Resolver::Resolver(Arena& arena) : arena_(arena), in_function_(false) {}
+
+void Resolver::resolve(ProgramNode& program) {
+    program.layout = make_layout(program.statements, ArenaList<Symbol>());
+    scopes_.push_back(program.layout);
+    resolve_statements(program.statements);
+    scopes_.pop_back();
+}
+
+void Resolver::resolve_function(const ArenaList<Symbol>& parameters, BlockNode& body) {
+    in_function_ = true;
+    body.layout = make_layout(body.statements, parameters);
+    scopes_.push_back(body.layout);
+    resolve_statements(body.statements);
+    scopes_.pop_back();
+}
+
+const ScopeLayout* Resolver::make_layout(const ArenaList<StatementNode*>& statements, const ArenaList<Symbol>& parameters) {
+    names_.assign(parameters.begin(), parameters.end());
+    collect_names(statements);
+    sort(names_.begin(), names_.end());
+    names_.erase(unique(names_.begin(), names_.end()), names_.end());
+
+    auto layout = arena_.make<ScopeLayout>();
+    layout->names = arena_.make_list<Symbol>(names_);
+    vector<uint32_t> slots;
+    for (const auto& parameter : parameters) {
+        slots.push_back(layout->find(parameter));
+    }
+    layout->parameters = arena_.make_list<uint32_t>(slots);
+    return layout;
+}
+
+// names assigned directly in a scope, nested bare blocks and functions get their own
+void Resolver::collect_names(const ArenaList<StatementNode*>& statements) {
+    for (const auto& statement : statements) {
+        switch (statement->kind) {
+        case NodeKind::Assignment:
+            names_.push_back(static_cast<const AssignmentNode*>(statement)->identifier);
+            break;
+
+        case NodeKind::Loop:
+            collect_names(static_cast<const LoopNode*>(statement)->body->statements);
+            break;
+
+        case NodeKind::IfElse: {
+            auto if_else = static_cast<const IfElseNode*>(statement);
+            collect_names(if_else->if_branch->statements);
+            if (if_else->else_branch) collect_names(if_else->else_branch->statements);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void Resolver::resolve_statements(const ArenaList<StatementNode*>& statements) {
+    for (const auto& statement : statements) {
+        resolve_statement(*statement);
+    }
+}
+
+void Resolver::resolve_statement(StatementNode& statement) {
+    switch (statement.kind) {
+    case NodeKind::Block: {
+        auto& block = static_cast<BlockNode&>(statement);
+        block.layout = make_layout(block.statements, ArenaList<Symbol>());
+        scopes_.push_back(block.layout);
+        resolve_statements(block.statements);
+        scopes_.pop_back();
+        break;
+    }
+    case NodeKind::Assignment: {
+        auto& assignment = static_cast<AssignmentNode&>(statement);
+        resolve_expression(*assignment.expression);
+        assignment.slot = scopes_.back()->find(assignment.identifier);
+        break;
+    }
+    case NodeKind::Loop: {
+        auto& loop = static_cast<LoopNode&>(statement);
+        resolve_expression(*loop.condition);
+        resolve_statements(loop.body->statements);
+        break;
+    }
+    case NodeKind::IfElse: {
+        auto& if_else = static_cast<IfElseNode&>(statement);
+        resolve_expression(*if_else.condition);
+        resolve_statements(if_else.if_branch->statements);
+        if (if_else.else_branch) resolve_statements(if_else.else_branch->statements);
+        break;
+    }
+    case NodeKind::FunctionDef: {
+        // pre-parsed bodies are resolved when they get parsed
+        auto& function = static_cast<FunctionDefNode&>(statement);
+        if (function.body) Resolver(arena_).resolve_function(function.parameters, *function.body);
+        break;
+    }
+    case NodeKind::ExpressionStatement:
+        resolve_expression(*static_cast<ExpressionStatementNode&>(statement).expression);
+        break;
+
+    case NodeKind::Return: {
+        auto& my_return = static_cast<ReturnNode&>(statement);
+        if (my_return.expression) resolve_expression(*my_return.expression);
+        // the frame of a function calling itself can only be reused while no bare block, whose
+        // variables the callee could still read, is open
+        my_return.tail_call = in_function_ && scopes_.size() == 1 && my_return.expression
+            && my_return.expression->kind == NodeKind::FunctionCall;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void Resolver::resolve_expression(ExpressionNode& expression) {
+    switch (expression.kind) {
+    case NodeKind::Variable:
+        bind(static_cast<VariableNode&>(expression), scopes_);
+        break;
+
+    case NodeKind::BinaryOp: {
+        auto& binary = static_cast<BinaryOpNode&>(expression);
+        resolve_expression(*binary.left);
+        resolve_expression(*binary.right);
+        break;
+    }
+    case NodeKind::UnaryOp:
+        resolve_expression(*static_cast<UnaryOpNode&>(expression).operand);
+        break;
+
+    case NodeKind::FunctionCall:
+        for (const auto& argument : static_cast<FunctionCallNode&>(expression).arguments) {
+            resolve_expression(*argument);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void Resolver::bind(VariableNode& variable, const vector<const ScopeLayout*>& scopes) {
+    uint32_t depth = 0;
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope, ++depth) {
+        uint32_t slot = (*scope)->find(variable.identifier);
+        if (slot != no_slot) {
+            variable.depth = depth;
+            variable.slot = slot;
+            return;
+        }
+    }
+    variable.depth = depth;
+    variable.slot = no_slot;
+}
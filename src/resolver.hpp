@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "symbols.hpp"
+
+using namespace std;
+
+// binds variables to slots of flat scopes, run once on every tree the parser hands out.
+// a scope is a function body, a bare block or the program, if and loop bodies belong to the
+// enclosing one. scoping is dynamic, so a function body is resolved on its own: names it doesn't
+// assign are left to a lookup along the callers' scopes at run time
+class Resolver {
+public:
+    // layouts are allocated in the given arena, next to the nodes they describe
+    explicit Resolver(Arena& arena);
+    void resolve(ProgramNode& program);
+    void resolve_function(const ArenaList<Symbol>& parameters, BlockNode& body);
+    // binds a variable read in the given scopes, innermost last, up to the enclosing function body
+    static void bind(VariableNode& variable, const vector<const ScopeLayout*>& scopes);
+    virtual ~Resolver() = default;
+
+private:
+    Arena& arena_;
+    // set while resolving a function body rather than the program
+    bool in_function_;
+    // layouts of the scopes enclosing the current node, innermost last, up to the function body
+    vector<const ScopeLayout*> scopes_;
+    vector<Symbol> names_;
+
+    const ScopeLayout* make_layout(const ArenaList<StatementNode*>& statements, const ArenaList<Symbol>& parameters);
+    void collect_names(const ArenaList<StatementNode*>& statements);
+
+    void resolve_statements(const ArenaList<StatementNode*>& statements);
+    void resolve_statement(StatementNode& statement);
+    void resolve_expression(ExpressionNode& expression);
+};
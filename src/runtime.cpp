@@ -0,0 +1,382 @@
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "optimizer.hpp"
+#include "parser.hpp"
+#include "runtime.hpp"
+
+using namespace std;
+
+namespace {
+
+constexpr bool is_number(Value::Type type) { return type == Value::Type::Long || type == Value::Type::Double; }
+constexpr bool has_truth(Value::Type type) { return is_number(type) || type == Value::Type::Bool; }
+
+// whether op gives a result for operands of these types, rather than an error
+constexpr bool is_valid(TokenType op, Value::Type left, Value::Type right) {
+    switch (op) {
+        // for long, doubles and booleans
+        case TokenType::LOGICAL_OR :
+        case TokenType::LOGICAL_AND : return has_truth(left) && has_truth(right);
+        // for long and doubles
+        case TokenType::LESS_THAN :
+        case TokenType::GREATER_THAN :
+        case TokenType::LESS_EQUAL :
+        case TokenType::GREATER_EQUAL :
+        case TokenType::MINUS :
+        case TokenType::MULTIPLY :
+        case TokenType::DIVIDE : return is_number(left) && is_number(right);
+        // for long, double, string and booleans
+        case TokenType::EQUAL :
+        case TokenType::NOT_EQUAL :
+            return (is_number(left) && is_number(right)) || (left == right && (left == Value::Type::String || left == Value::Type::Bool));
+        // for long, double and strings, anything can be appended to a string
+        case TokenType::PLUS :
+            return (is_number(left) && is_number(right)) ||
+                ((left == Value::Type::String || right == Value::Type::String) && left != Value::Type::Unset && right != Value::Type::Unset);
+        // for longs
+        case TokenType::MODULO : return left == Value::Type::Long && right == Value::Type::Long;
+        default: return false;
+    }
+}
+
+template <Value::Type type>
+double number(const Value& value) {
+    if constexpr (type == Value::Type::Long) return static_cast<double>(value.as_long());
+    else return value.as_double();
+}
+
+template <Value::Type type>
+bool truth(const Value& value) {
+    if constexpr (type == Value::Type::Bool) return value.as_bool();
+    else if constexpr (type == Value::Type::Long) return value.as_long() != 0;
+    else return value.as_double() != 0.0;
+}
+
+// a long and a double compared without rounding the long: -1, 0 or 1, unordered for NaN
+constexpr int unordered = 2;
+int compare(long a, double b) {
+    // every long of at most 53 bits is exactly a double
+    constexpr long exact = 1L << 53;
+    if (a >= -exact && a <= exact) {
+        const double x = static_cast<double>(a);
+        return x < b ? -1 : x > b ? 1 : x == b ? 0 : unordered;
+    }
+    if (b != b) return unordered;
+    if (b >= 9223372036854775808.0) return -1;
+    if (b < -9223372036854775808.0) return 1;
+    // b is within the range of long, its integral part and its fraction are exact
+    const long integral = static_cast<long>(b);
+    if (a != integral) return a < integral ? -1 : 1;
+    const double fraction = b - static_cast<double>(integral);
+    return fraction > 0 ? -1 : fraction < 0 ? 1 : 0;
+}
+
+template <TokenType op>
+bool compared(int order) {
+    if constexpr (op == TokenType::LESS_THAN) return order == -1;
+    else if constexpr (op == TokenType::GREATER_THAN) return order == 1;
+    else if constexpr (op == TokenType::LESS_EQUAL) return order == -1 || order == 0;
+    else if constexpr (op == TokenType::GREATER_EQUAL) return order == 1 || order == 0;
+    else if constexpr (op == TokenType::EQUAL) return order == 0;
+    else return order != 0;
+}
+
+// longs stay exact. a sum, difference or product that overflows is promoted to a double, and so
+// is a quotient that isn't whole
+template <TokenType op>
+Value long_kernel(Runtime& runtime, long a, long b, uint32_t position) {
+    long result;
+    if constexpr (op == TokenType::PLUS) {
+        if (!__builtin_add_overflow(a, b, &result)) return result;
+        return static_cast<double>(a) + static_cast<double>(b);
+    } else if constexpr (op == TokenType::MINUS) {
+        if (!__builtin_sub_overflow(a, b, &result)) return result;
+        return static_cast<double>(a) - static_cast<double>(b);
+    } else if constexpr (op == TokenType::MULTIPLY) {
+        if (!__builtin_mul_overflow(a, b, &result)) return result;
+        return static_cast<double>(a) * static_cast<double>(b);
+    } else if constexpr (op == TokenType::DIVIDE) {
+        if (b == 0) throw runtime_error(runtime.error_message("Division by zero", position));
+        // LONG_MIN / -1 overflows
+        if (b == -1 && !__builtin_sub_overflow(0L, a, &result)) return result;
+        if (b != -1 && a % b == 0) return a / b;
+        return static_cast<double>(a) / static_cast<double>(b);
+    } else if constexpr (op == TokenType::MODULO) {
+        // the sign of the dividend, LONG_MIN % -1 is 0 rather than a trap
+        if (b == 0) throw runtime_error(runtime.error_message("Division by zero", position));
+        return b == -1 ? 0L : a % b;
+    } else if constexpr (op == TokenType::LESS_THAN) return a < b;
+    else if constexpr (op == TokenType::GREATER_THAN) return a > b;
+    else if constexpr (op == TokenType::LESS_EQUAL) return a <= b;
+    else if constexpr (op == TokenType::GREATER_EQUAL) return a >= b;
+    else if constexpr (op == TokenType::EQUAL) return a == b;
+    else return a != b;
+}
+
+constexpr bool is_comparison(TokenType op) {
+    return op == TokenType::LESS_THAN || op == TokenType::GREATER_THAN || op == TokenType::LESS_EQUAL ||
+        op == TokenType::GREATER_EQUAL || op == TokenType::EQUAL || op == TokenType::NOT_EQUAL;
+}
+
+// op on operands known to have types L and R, a valid combination
+template <TokenType op, Value::Type L, Value::Type R>
+Value binary_kernel(Runtime& runtime, TokenType, const Value& left, const Value& right, uint32_t position) {
+    if constexpr (op == TokenType::LOGICAL_AND) {
+        return truth<L>(left) && truth<R>(right);
+    } else if constexpr (op == TokenType::LOGICAL_OR) {
+        return truth<L>(left) || truth<R>(right);
+    } else if constexpr (op == TokenType::PLUS && L == Value::Type::String && R == Value::Type::String) {
+        return left.as_string() + right.as_string();
+    } else if constexpr (op == TokenType::PLUS && (L == Value::Type::String || R == Value::Type::String)) {
+        string text;
+        runtime.append_string(left, text, position);
+        runtime.append_string(right, text, position);
+        return text;
+    } else if constexpr (L == Value::Type::Long && R == Value::Type::Long) {
+        return long_kernel<op>(runtime, left.as_long(), right.as_long(), position);
+    } else if constexpr (L == Value::Type::String) {
+        const bool equal = left.as_string() == right.as_string();
+        return op == TokenType::EQUAL ? equal : !equal;
+    } else if constexpr (L == Value::Type::Bool) {
+        const bool equal = left.as_bool() == right.as_bool();
+        return op == TokenType::EQUAL ? equal : !equal;
+    } else if constexpr (is_comparison(op) && L == Value::Type::Long) {
+        return compared<op>(compare(left.as_long(), right.as_double()));
+    } else if constexpr (is_comparison(op) && R == Value::Type::Long) {
+        // the order of b against a, turned around
+        const int order = compare(right.as_long(), left.as_double());
+        return compared<op>(order == unordered ? order : -order);
+    } else {
+        const double a = number<L>(left), b = number<R>(right);
+        if constexpr (op == TokenType::PLUS) return a + b;
+        else if constexpr (op == TokenType::MINUS) return a - b;
+        else if constexpr (op == TokenType::MULTIPLY) return a * b;
+        else if constexpr (op == TokenType::DIVIDE) {
+            if (b == 0) throw runtime_error(runtime.error_message("Division by zero", position));
+            return a / b;
+        }
+        else if constexpr (op == TokenType::LESS_THAN) return a < b;
+        else if constexpr (op == TokenType::GREATER_THAN) return a > b;
+        else if constexpr (op == TokenType::LESS_EQUAL) return a <= b;
+        else if constexpr (op == TokenType::GREATER_EQUAL) return a >= b;
+        else if constexpr (op == TokenType::EQUAL) return a == b;
+        else return a != b;
+    }
+}
+
+template <size_t index>
+constexpr Runtime::binary_kernel make_binary_kernel() {
+    constexpr TokenType op = static_cast<TokenType>(TokenType::MULTIPLY + index / (Value::type_count * Value::type_count));
+    constexpr Value::Type left = static_cast<Value::Type>(index / Value::type_count % Value::type_count);
+    constexpr Value::Type right = static_cast<Value::Type>(index % Value::type_count);
+    if constexpr (is_valid(op, left, right)) return &binary_kernel<op, left, right>;
+    else return &Runtime::invalid_operands;
+}
+
+template <size_t... indices>
+constexpr array<Runtime::binary_kernel, sizeof...(indices)> make_binary_kernels(index_sequence<indices...>) {
+    return {{ make_binary_kernel<indices>()... }};
+}
+
+}
+
+const array<Runtime::binary_kernel, binary_operator_count * Value::type_count * Value::type_count> Runtime::binary_kernels_ =
+    make_binary_kernels(make_index_sequence<binary_operator_count * Value::type_count * Value::type_count>());
+
+Runtime::Runtime() : program_(nullptr) {
+    // [] -> captures variables to use inside the lambda function
+    native_functions_["print"] = [this](const vector<Value>& arguments, uint32_t position) {
+        // the line is formatted in a buffer kept from one print to the next
+        string& out = this->print_buffer_;
+        out.clear();
+        for (const auto& argument : arguments) {
+            if (&argument != &arguments.front()) out += ' ';
+            this->append_string(argument, out, position);
+        }
+        out += '\n';
+        cout.write(out.data(), out.size());
+        cout.flush();
+
+        return Value();
+    };
+
+    native_functions_["pow"] = [this](const vector<Value>& arguments, uint32_t position) {
+        if (arguments.size() != 2) {
+            throw runtime_error(error_message("pow funciton requires exactly 2 arguments: base and exponent", position));
+        }
+
+        double base = to_double(arguments[0], position);
+        double exponent = to_double(arguments[1], position);
+
+        return pow(base, exponent);
+    };
+}
+
+void Runtime::attach(const ProgramNode& program) {
+    program_ = &program;
+    for (const auto& [name, function] : native_functions_) {
+        native_symbols_[program.symbols.intern(name)] = &function;
+    }
+}
+
+const native_function* Runtime::native(Symbol name) const {
+    auto it = native_symbols_.find(name);
+    return it != native_symbols_.end() ? it->second : nullptr;
+}
+
+// print writes to the output, pow only computes
+bool Runtime::pure_native(Symbol name) const {
+    return native(name) && program_->symbols.name(name) == "pow";
+}
+
+const BlockNode* Runtime::parse_body(const FunctionDefNode& definition) {
+    auto parsed = parsed_bodies_.find(&definition);
+    if (parsed != parsed_bodies_.end()) return parsed->second;
+
+    try {
+        // nested function definitions stay pre-parsed as well
+        Parser parser = Parser(true);
+        BlockNode* body = parser.parse_function_body(definition, *program_, parsed_bodies_arena_);
+        if (program_->optimized) Optimizer(parsed_bodies_arena_).optimize_function(*program_, *body);
+        return parsed_bodies_[&definition] = body;
+    } catch (const runtime_error& e) {
+        throw syntax_error(e.what());
+    }
+}
+
+const Value& Runtime::string_literal(Symbol symbol) {
+    if (symbol >= string_literals_.size()) string_literals_.resize(program_->symbols.size());
+    Value& literal = string_literals_[symbol];
+    if (literal.is_null()) literal = Value(string(program_->symbols.name(symbol)));
+    return literal;
+}
+
+// the one kernel of every invalid combination, it only has to find the message
+Value Runtime::invalid_operands(Runtime& runtime, TokenType op, const Value& left, const Value& right, uint32_t position) {
+    switch (op) {
+        case TokenType::LOGICAL_OR :
+        case TokenType::LOGICAL_AND : throw runtime_error(runtime.error_message("Expected a boolean or a number", position));
+        case TokenType::EQUAL :
+        case TokenType::NOT_EQUAL : throw runtime_error(runtime.error_message("Unexpected types of operands", position));
+        case TokenType::PLUS : {
+            if (left.is_string() || right.is_string()) throw runtime_error(runtime.error_message("Cannot convert to string", position));
+            throw runtime_error(runtime.error_message("Expected a string or a number", position));
+        }
+        case TokenType::MODULO : throw runtime_error(runtime.error_message("Modulo requires integers", position));
+        case TokenType::LESS_THAN :
+        case TokenType::GREATER_THAN :
+        case TokenType::LESS_EQUAL :
+        case TokenType::GREATER_EQUAL :
+        case TokenType::MINUS :
+        case TokenType::MULTIPLY :
+        case TokenType::DIVIDE : throw runtime_error(runtime.error_message("Expected a number", position));
+        default: throw runtime_error(runtime.error_message("Invallid operator", position));
+    }
+}
+
+Value Runtime::unary_op(TokenType op, const Value& operand, uint32_t position) {
+    if (op == TokenType::MINUS) {
+        long result;
+        // -LONG_MIN is promoted like an overflowing difference
+        if (operand.is_long()) {
+            if (!__builtin_sub_overflow(0L, operand.as_long(), &result)) return result;
+            return -static_cast<double>(operand.as_long());
+        }
+        if (operand.is_double()) return -operand.as_double();
+        throw runtime_error(error_message("Expected a number", position));
+    }
+    throw runtime_error(error_message("Invalid unary operator", position));
+}
+
+double Runtime::to_double(const Value& value, uint32_t position) {
+    switch (value.type()) {
+    case Value::Type::Long: return static_cast<double>(value.as_long());
+    case Value::Type::Double: return value.as_double();
+    default: throw runtime_error(error_message("Expected a number", position));
+    }
+}
+
+long Runtime::to_long(const Value& value, uint32_t position) {
+    switch (value.type()) {
+    case Value::Type::Long: return value.as_long();
+    case Value::Type::Double: throw runtime_error(error_message("Expected an integer", position));
+    default: throw runtime_error(error_message("Expected a number", position));
+    }
+}
+
+bool Runtime::to_boolean(const Value& value, uint32_t position) {
+    switch (value.type()) {
+    case Value::Type::Bool: return value.as_bool();
+    case Value::Type::Long: return value.as_long() != 0;
+    case Value::Type::Double: return value.as_double() != 0.0;
+    default: throw runtime_error(error_message("Expected a boolean or a number", position));
+    }
+}
+
+void Runtime::append_string(const Value& value, string& out, uint32_t position) {
+    // fixed notation with the fewest digits that still read back as the same double
+    char buffer[512];
+    switch (value.type()) {
+    case Value::Type::String:
+        out += value.as_string();
+        return;
+    case Value::Type::Long:
+        out.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value.as_long()).ptr);
+        return;
+    case Value::Type::Double:
+        out.append(buffer, to_chars(buffer, buffer + sizeof(buffer), value.as_double(), chars_format::fixed).ptr);
+        return;
+    case Value::Type::Bool:
+        out += value.as_bool() ? "true" : "false";
+        return;
+    case Value::Type::Null:
+        out += "null";
+        return;
+    default:
+        throw runtime_error(error_message("Cannot convert to string", position));
+    }
+}
+
+string Runtime::error_message(const string& message, uint32_t position) {
+    // safely constructing the string
+    stringstream string_stream;
+    string_stream << "Error at " << program_->lines.line(position) << ", " << program_->lines.column(position) << " : " << message;
+    return string_stream.str();
+}
+
+// s = s + a + b ..., with s assigned in the innermost scope
+bool Runtime::is_append(const AssignmentNode& assignment) {
+    const ExpressionNode* expression = assignment.expression;
+    while (expression->kind == NodeKind::BinaryOp && static_cast<const BinaryOpNode*>(expression)->op == TokenType::PLUS) {
+        expression = static_cast<const BinaryOpNode*>(expression)->left;
+    }
+    if (expression == assignment.expression || expression->kind != NodeKind::Variable) return false;
+    auto variable = static_cast<const VariableNode*>(expression);
+    return variable->depth == 0 && variable->slot == assignment.slot;
+}
+
+Value Runtime::append(Value target, const Value* operands, size_t count, uint32_t position) {
+    // in place unless the string is shared
+    string* text = target.unique_string();
+    if (!text) {
+        target = Value(target.as_string());
+        text = target.unique_string();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        append_string(operands[i], *text, position);
+    }
+    return target;
+}
+
+runtime_error Runtime::undefined_variable(Symbol name) {
+    return runtime_error("Undefined variable " + string(program_->symbols.name(name)));
+}
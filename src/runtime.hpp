@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.hpp"
+#include "ast.hpp"
+#include "symbols.hpp"
+#include "token.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+using native_function = function<Value(const vector<Value>&, uint32_t position)>;
+
+// binary operators are contiguous in TokenType, from MULTIPLY to LOGICAL_OR
+constexpr size_t binary_operator_count = TokenType::LOGICAL_OR - TokenType::MULTIPLY + 1;
+
+// raised when a pre-parsed body fails to parse, it isn't folded into "Error inside block"
+struct syntax_error : runtime_error {
+    using runtime_error::runtime_error;
+};
+
+// what every way of running a program shares: the operators and conversions of the language,
+// the native functions, string literals and the bodies parsed on their first call.
+// errors are reported at a position of the attached program
+class Runtime {
+public:
+    Runtime();
+    Runtime(const Runtime&) = delete;
+    Runtime& operator=(const Runtime&) = delete;
+    virtual ~Runtime() = default;
+
+    void attach(const ProgramNode& program);
+    const ProgramNode& program() const { return *program_; }
+
+    // null when name isn't a native function
+    const native_function* native(Symbol name) const;
+    // natives whose result only depends on their arguments, see Purity
+    bool pure_native(Symbol name) const;
+    const BlockNode* parse_body(const FunctionDefNode& definition);
+    // literals are built once and then shared by every evaluation
+    const Value& string_literal(Symbol symbol);
+
+    // an operator applied to operands of two given types. every valid combination has a kernel
+    // of its own, generated from a template, the others share invalid_operands
+    using binary_kernel = Value (*)(Runtime& runtime, TokenType op, const Value& left, const Value& right, uint32_t position);
+    static binary_kernel kernel(TokenType op, Value::Type left, Value::Type right) {
+        return binary_kernels_[((op - TokenType::MULTIPLY) * Value::type_count + static_cast<size_t>(left)) * Value::type_count + static_cast<size_t>(right)];
+    }
+    static Value invalid_operands(Runtime& runtime, TokenType op, const Value& left, const Value& right, uint32_t position);
+
+    Value binary_op(TokenType op, const Value& left, const Value& right, uint32_t position) {
+        // a single indirect call, nothing tests the types of the operands
+        return kernel(op, left.type(), right.type())(*this, op, left, right, position);
+    }
+    Value unary_op(TokenType op, const Value& operand, uint32_t position);
+    // and, or: the right operand only runs when the left one doesn't decide, both go through to_boolean
+    static bool is_short_circuit(TokenType op) { return op == TokenType::LOGICAL_AND || op == TokenType::LOGICAL_OR; }
+    // s = s + a + b ..., with s assigned in the innermost scope
+    static bool is_append(const AssignmentNode& assignment);
+    // target + operands[0] + operands[1] ..., target being a string
+    Value append(Value target, const Value* operands, size_t count, uint32_t position);
+
+    double to_double(const Value& value, uint32_t position);
+    long to_long(const Value& value, uint32_t position);
+    bool to_boolean(const Value& value, uint32_t position);
+    void append_string(const Value& value, string& out, uint32_t position);
+
+    string error_message(const string& message, uint32_t position);
+    runtime_error undefined_variable(Symbol name);
+
+private:
+    // indexed by operator, left type and right type
+    static const array<binary_kernel, binary_operator_count * Value::type_count * Value::type_count> binary_kernels_;
+
+    const ProgramNode* program_;
+
+    unordered_map<string_view, native_function> native_functions_;
+    unordered_map<Symbol, const native_function*> native_symbols_;
+    // shared values of the string literals, indexed by symbol
+    vector<Value> string_literals_;
+    string print_buffer_;
+
+    // bodies parsed on their first call, kept for every later call of the same definition
+    Arena parsed_bodies_arena_;
+    unordered_map<const FunctionDefNode*, const BlockNode*> parsed_bodies_;
+};
@@ -0,0 +1,139 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "scan.hpp"
+
+#if !defined(SIA_SCALAR_SCAN) && defined(__AVX2__)
+    #include <immintrin.h>
+    #define SIA_SCAN_AVX2
+#elif !defined(SIA_SCALAR_SCAN) && defined(__SSE2__)
+    #include <emmintrin.h>
+    #define SIA_SCAN_SSE2
+#endif
+
+// every vector variant compares one block of bytes at a time and turns the result into a bitmask,
+// bit i being set when byte i matched
+#if defined(SIA_SCAN_AVX2)
+
+static const size_t block_size = 32;
+using block = __m256i;
+
+static block load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const block*>(p)); }
+static block equal(block bytes, char c) { return _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)); }
+static block either(block a, block b) { return _mm256_or_si256(a, b); }
+static block both(block a, block b) { return _mm256_and_si256(a, b); }
+static uint32_t mask(block matches) { return static_cast<uint32_t>(_mm256_movemask_epi8(matches)); }
+
+#elif defined(SIA_SCAN_SSE2)
+
+static const size_t block_size = 16;
+using block = __m128i;
+
+static block load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const block*>(p)); }
+static block equal(block bytes, char c) { return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)); }
+static block either(block a, block b) { return _mm_or_si128(a, b); }
+static block both(block a, block b) { return _mm_and_si128(a, b); }
+static uint32_t mask(block matches) { return static_cast<uint32_t>(_mm_movemask_epi8(matches)); }
+
+#endif
+
+#if defined(SIA_SCAN_AVX2) || defined(SIA_SCAN_SSE2)
+static const uint32_t full_mask = static_cast<uint32_t>((uint64_t(1) << block_size) - 1);
+
+static block line_break_candidates(block bytes) { return either(equal(bytes, '\n'), equal(bytes, '\r')); }
+
+// every '\n', and every '\r' that isn't the first half of "\r\n".
+// p + block_size must be readable, the shifted load is only needed when the block has a '\r'
+static uint32_t line_breaks(block bytes, const char* p) {
+    uint32_t breaks = mask(equal(bytes, '\n'));
+    if (uint32_t returns = mask(equal(bytes, '\r'))) breaks |= returns & ~mask(equal(load(p + 1), '\n'));
+    return breaks;
+}
+
+// the bits below the lowest set bit of matches
+static uint32_t before(uint32_t matches) { return (matches & -matches) - 1; }
+#endif
+
+static bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\v' || c == '\f'; }
+static bool is_line_break(const char* p, const char* end) { return *p == '\n' || (*p == '\r' && (p + 1 == end || p[1] != '\n')); }
+
+const char* scan_blanks(const char* begin, const char* end) {
+    const char* p = begin;
+#if defined(SIA_SCAN_AVX2) || defined(SIA_SCAN_SSE2)
+    // most runs are short indentation, so check the first byte before paying for a vector load
+    if (p < end && !is_blank(*p)) return p;
+    for (; p + block_size <= end; p += block_size) {
+        block bytes = load(p);
+        uint32_t blanks = mask(either(either(equal(bytes, ' '), equal(bytes, '\t')), either(equal(bytes, '\v'), equal(bytes, '\f'))));
+        if (blanks != full_mask) return p + __builtin_ctz(~blanks & full_mask);
+    }
+#endif
+    while (p < end && is_blank(*p)) p++;
+    return p;
+}
+
+const char* scan_quote(const char* begin, const char* end, size_t& newlines) {
+    const char* p = begin;
+#if defined(SIA_SCAN_AVX2) || defined(SIA_SCAN_SSE2)
+    for (; p + block_size + 1 <= end; p += block_size) {
+        block bytes = load(p);
+        block quotes = equal(bytes, '"');
+        // most blocks have neither a quote nor a line break, skip them with a single test
+        if (!mask(either(quotes, line_break_candidates(bytes)))) continue;
+
+        uint32_t breaks = line_breaks(bytes, p);
+        if (uint32_t found = mask(quotes)) {
+            newlines += __builtin_popcount(breaks & before(found));
+            return p + __builtin_ctz(found);
+        }
+        newlines += __builtin_popcount(breaks);
+    }
+#endif
+    for (; p < end && *p != '"'; p++) {
+        if (is_line_break(p, end)) newlines++;
+    }
+    return p;
+}
+
+const char* scan_line_end(const char* begin, const char* end) {
+    const char* p = begin;
+#if defined(SIA_SCAN_AVX2) || defined(SIA_SCAN_SSE2)
+    for (; p + block_size <= end; p += block_size) {
+        block bytes = load(p);
+        uint32_t breaks = mask(either(equal(bytes, '\n'), equal(bytes, '\r')));
+        if (breaks) return p + __builtin_ctz(breaks);
+    }
+#endif
+    while (p < end && *p != '\n' && *p != '\r') p++;
+    return p;
+}
+
+const char* scan_block_comment_end(const char* begin, const char* end, size_t& newlines) {
+    const char* p = begin;
+#if defined(SIA_SCAN_AVX2) || defined(SIA_SCAN_SSE2)
+    for (; p + block_size + 1 <= end; p += block_size) {
+        block bytes = load(p);
+        block stars = equal(bytes, '*');
+        if (!mask(either(stars, line_break_candidates(bytes)))) continue;
+
+        uint32_t breaks = line_breaks(bytes, p);
+        // the second load is shifted by one byte so a "*/" pair lines up on the same bit
+        if (uint32_t closes = mask(both(stars, equal(load(p + 1), '/')))) {
+            newlines += __builtin_popcount(breaks & before(closes));
+            return p + __builtin_ctz(closes);
+        }
+        newlines += __builtin_popcount(breaks);
+    }
+#endif
+    for (; p + 1 < end; p++) {
+        if (p[0] == '*' && p[1] == '/') return p;
+        if (is_line_break(p, end)) newlines++;
+    }
+    return end;
+}
+
+const char* scan_last_line(const char* begin, const char* end) {
+    const char* p = end;
+    while (p > begin && p[-1] != '\n' && p[-1] != '\r') p--;
+    return p;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+// byte-scanning kernels used by the lexer to skip over blanks, comments and string bodies.
+// they process 32 (AVX2) or 16 (SSE2) bytes at a time and fall back to a scalar loop otherwise,
+// define SIA_SCALAR_SCAN to force the scalar versions.
+// every function works on [begin, end) and returns end when nothing is found,
+// line breaks are counted the way the lexer does, with "\r\n" counting as one
+
+// first byte that isn't one of ' ', '\t', '\v', '\f'
+const char* scan_blanks(const char* begin, const char* end);
+
+// first '"', the line breaks before it are added to newlines
+const char* scan_quote(const char* begin, const char* end, size_t& newlines);
+
+// first '\n' or '\r'
+const char* scan_line_end(const char* begin, const char* end);
+
+// the '*' of the first "*/", the line breaks before it are added to newlines
+const char* scan_block_comment_end(const char* begin, const char* end, size_t& newlines);
+
+// start of the last line in [begin, end), begin if there is no line break
+const char* scan_last_line(const char* begin, const char* end);
@@ -0,0 +1,50 @@
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.hpp"
+
+using namespace std;
+
+Source::Source(const string& filepath) : mapping_(nullptr), mapping_size_(0) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw runtime_error("Could not open file: " + filepath);
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // the lexer only moves forward through the buffer
+            madvise(mapping, info.st_size, MADV_SEQUENTIAL);
+            mapping_ = mapping;
+            mapping_size_ = info.st_size;
+        }
+    }
+    close(fd);
+
+    if (mapping_) {
+        text_ = string_view(static_cast<const char*>(mapping_), mapping_size_);
+        return;
+    }
+
+    ifstream file(filepath);
+    if (!file.is_open()) {
+        throw runtime_error("Could not open file: " + filepath);
+    }
+    stringstream buffer;
+    buffer << file.rdbuf();
+    buffer_ = buffer.str();
+    text_ = buffer_;
+}
+
+Source::~Source() {
+    if (mapping_) munmap(mapping_, mapping_size_);
+}
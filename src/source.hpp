@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// read-only view of a .sia file, memory-mapped when possible.
+// tokens and literals point into this buffer, so it must outlive the parse and the evaluation
+class Source {
+public:
+    explicit Source(const string& filepath);
+    Source(const Source&) = delete;
+    Source& operator=(const Source&) = delete;
+    virtual ~Source();
+
+    string_view text() const { return text_; }
+
+private:
+    void* mapping_;
+    size_t mapping_size_;
+    // only used when the file can't be mapped (empty files, pipes, ...)
+    string buffer_;
+    string_view text_;
+};
@@ -0,0 +1,20 @@
+#include <string_view>
+
+#include "symbols.hpp"
+
+using namespace std;
+
+Symbol SymbolTable::intern(string_view text) {
+    auto [it, inserted] = ids_.try_emplace(text, static_cast<Symbol>(names_.size()));
+    if (inserted) names_.push_back(text);
+    return it->second;
+}
+
+uint32_t LineTable::add(unsigned int line, unsigned int column) {
+    // nodes built from the same token (a call and its statement, "else if") share their entry
+    if (!positions_.empty() && positions_.back().line == line && positions_.back().column == column) {
+        return positions_.size() - 1;
+    }
+    positions_.push_back({line, column});
+    return positions_.size() - 1;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// identifiers and string literals are interned once per program, nodes only keep the 32-bit id
+using Symbol = uint32_t;
+
+class SymbolTable {
+public:
+    // the text isn't copied, it has to outlive the table
+    Symbol intern(string_view text);
+    string_view name(Symbol symbol) const { return names_[symbol]; }
+    size_t size() const { return names_.size(); }
+
+private:
+    vector<string_view> names_;
+    unordered_map<string_view, Symbol> ids_;
+};
+
+// line and column of the nodes, kept out of the nodes since they are only read to report errors
+class LineTable {
+public:
+    uint32_t add(unsigned int line, unsigned int column);
+    unsigned int line(uint32_t position) const { return positions_[position].line; }
+    unsigned int column(uint32_t position) const { return positions_[position].column; }
+    size_t size() const { return positions_.size(); }
+
+private:
+    struct entry {
+        unsigned int line, column;
+    };
+    vector<entry> positions_;
+};
@@ -1,8 +1,9 @@
 #pragma once
 
-#include <string>
+#include <string_view>
 
-enum TokenType {
+// one byte, so operator nodes stay small
+enum TokenType : unsigned char {
     // identifiers
     IDENTIFIER,
     // spaces
@@ -21,11 +22,12 @@ enum TokenType {
     LOGICAL_OR,
 };
 
+// the lexeme points into the source buffer, it is only valid as long as the source is
 struct Token {
     TokenType type;
-    std::string lexeme;
+    std::string_view lexeme;
     unsigned int line, column;
 
-    Token(TokenType type, std::string lexeme, unsigned int line, unsigned int column)
+    Token(TokenType type, std::string_view lexeme, unsigned int line, unsigned int column)
         : type(type), lexeme(lexeme), line(line), column(column) {}
 };
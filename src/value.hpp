@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+using namespace std;
+
+// values share strings and only count their references. a string is never changed
+// while another value refers to it, see Value::unique_string
+struct StringObject {
+    size_t references;
+    string text;
+};
+
+// a value of the language in 16 bytes. longs, doubles, booleans and null are stored inline,
+// a string points to a shared, reference counted StringObject
+class Value {
+public:
+    enum class Type : unsigned char {
+        Long, Double, String, Bool, Null,
+        // a variable's slot before it is first assigned, never seen by programs
+        Unset,
+    };
+    static constexpr size_t type_count = static_cast<size_t>(Type::Unset) + 1;
+
+    Value() : type_(Type::Null), long_(0) {}
+    Value(long value) : type_(Type::Long), long_(value) {}
+    Value(double value) : type_(Type::Double), double_(value) {}
+    Value(bool value) : type_(Type::Bool), long_(0) { bool_ = value; }
+    Value(string value) : type_(Type::String), string_(new StringObject{ 1, std::move(value) }) {}
+    // would silently pick the bool constructor
+    Value(const char*) = delete;
+
+    static Value unset() {
+        Value value;
+        value.type_ = Type::Unset;
+        return value;
+    }
+
+    Value(const Value& other) : type_(other.type_), long_(other.long_) {
+        if (type_ == Type::String) string_->references++;
+    }
+    Value(Value&& other) noexcept : type_(other.type_), long_(other.long_) {
+        other.type_ = Type::Null;
+    }
+    Value& operator=(const Value& other) {
+        if (this != &other) *this = Value(other);
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            type_ = other.type_;
+            long_ = other.long_;
+            other.type_ = Type::Null;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
+
+    Type type() const { return type_; }
+    bool is_long() const { return type_ == Type::Long; }
+    bool is_double() const { return type_ == Type::Double; }
+    bool is_number() const { return type_ == Type::Long || type_ == Type::Double; }
+    bool is_string() const { return type_ == Type::String; }
+    bool is_bool() const { return type_ == Type::Bool; }
+    bool is_null() const { return type_ == Type::Null; }
+    bool is_unset() const { return type_ == Type::Unset; }
+
+    long as_long() const { return long_; }
+    double as_double() const { return double_; }
+    bool as_bool() const { return bool_; }
+    const string& as_string() const { return string_->text; }
+    // the characters of a string no other value refers to, null when they are shared
+    string* unique_string() { return type_ == Type::String && string_->references == 1 ? &string_->text : nullptr; }
+
+private:
+    Type type_;
+    union {
+        long long_;
+        double double_;
+        bool bool_;
+        StringObject* string_;
+    };
+
+    void release() {
+        if (type_ == Type::String && --string_->references == 0) delete string_;
+    }
+};
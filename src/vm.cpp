@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vm.hpp"
+
+using namespace std;
+
+VM::VM() : compiler_(bytecode_, runtime_), calls_(0), tail_calls_(0), depth_(0), peak_depth_(0) {}
+
+void VM::evaluate(const ProgramNode& program) {
+    runtime_.attach(program);
+    compiler_.compile_program(program, program_chunk_);
+    environment_.push(*program.layout);
+    stack_.resize(max<size_t>(256, program_chunk_.max_stack + 1));
+    frames_.push_back({ &program_chunk_, nullptr, 0, environment_.depth(), 0 });
+    execute();
+}
+
+void VM::disassemble(const ProgramNode& program, ostream& out) {
+    runtime_.attach(program);
+    compiler_.compile_program(program, program_chunk_);
+    out << "== program\n";
+    ::disassemble(program_chunk_, bytecode_, program, out);
+
+    // every DEFINE met so far, including those in the bodies compiled along the way
+    for (size_t i = 0; i < bytecode_.nodes.size(); ++i) {
+        if (bytecode_.nodes[i]->kind != NodeKind::FunctionDef) continue;
+        auto& definition = static_cast<const FunctionDefNode&>(*bytecode_.nodes[i]);
+        const Chunk& chunk = function_chunk(definition);
+        out << "\n== " << program.symbols.name(definition.name) << "\n";
+        ::disassemble(chunk, bytecode_, program, out);
+    }
+}
+
+void VM::print_stats(ostream& out) const {
+    const auto& environment = environment_.statistics();
+    out << "calls: " << calls_ << endl;
+    out << "tail calls: " << tail_calls_ << endl;
+    out << "peak call depth: " << peak_depth_ << endl;
+    out << "scopes: " << environment.scopes << endl;
+    out << "value stack growths: " << environment.growths << endl;
+    out << "peak stack slots: " << environment.peak_slots << endl;
+}
+
+const Chunk& VM::function_chunk(const FunctionDefNode& definition) {
+    const BlockNode* body = definition.body ? definition.body : runtime_.parse_body(definition);
+    auto it = chunks_.find(body);
+    if (it != chunks_.end()) return it->second;
+    Chunk& chunk = chunks_[body];
+    compiler_.compile_function(*body, chunk);
+    return chunk;
+}
+
+// room for everything the chunk pushes, the operand stack is moved when it grows
+Value* VM::ensure_stack(Value* sp, const Chunk& chunk) {
+    const size_t used = sp - stack_.data();
+    if (used + chunk.max_stack + 1 > stack_.size()) {
+        stack_.resize(max(stack_.size() * 2, used + chunk.max_stack + 1));
+    }
+    return stack_.data() + used;
+}
+
+// the tree walker reports any error raised inside a block at the outermost block around it,
+// which is either a block of the top-level code or the body of the first function called from it
+runtime_error VM::block_error(const runtime_error& error, const Instruction* ip) {
+    const Instruction* top_level = frames_.size() > 1 ? frames_[1].return_ip - 1 : ip;
+    const size_t pc = top_level - program_chunk_.code.data();
+    for (const auto& block : program_chunk_.blocks) {
+        if (pc >= block.begin && pc < block.end) {
+            return runtime_error(runtime_.error_message("Error inside block", block.position));
+        }
+    }
+    if (frames_.size() > 1) {
+        return runtime_error(runtime_.error_message("Error inside block", frames_[1].chunk->body->position));
+    }
+    return error;
+}
+
+#ifdef SIA_COMPUTED_GOTO
+#define DISPATCH() do { instruction = ip++; goto *labels[static_cast<size_t>(instruction->op)]; } while (0)
+#define OP(name) op_##name:
+#else
+#define DISPATCH() continue
+#define OP(name) case OpCode::name:
+#endif
+
+void VM::execute() {
+    const Instruction* code = frames_.back().chunk->code.data();
+    const Instruction* ip = code;
+    const Instruction* instruction = ip;
+    Value* sp = stack_.data();
+    Value* locals = environment_.locals();
+
+#ifdef SIA_COMPUTED_GOTO
+    static const void* const labels[] = {
+#define SIA_OPCODE_LABEL(name) &&op_##name,
+        SIA_OPCODES(SIA_OPCODE_LABEL)
+#undef SIA_OPCODE_LABEL
+    };
+#endif
+
+    try {
+        for (;;) {
+#ifdef SIA_COMPUTED_GOTO
+            DISPATCH();
+#else
+            instruction = ip++;
+            switch (instruction->op) {
+#endif
+
+            OP(CONSTANT) {
+                *sp++ = bytecode_.constants[instruction->a];
+                DISPATCH();
+            }
+            OP(LOAD_LOCAL) {
+                const Value& value = locals[instruction->a];
+                if (!value.is_unset()) {
+                    *sp++ = value;
+                    DISPATCH();
+                }
+            }
+            // falls through while the slot isn't assigned yet
+            OP(LOAD_VARIABLE) {
+                auto& variable = static_cast<const VariableNode&>(*bytecode_.nodes[instruction->b]);
+                const Value* value = environment_.find(variable);
+                if (!value) throw runtime_.undefined_variable(variable.identifier);
+                *sp++ = *value;
+                DISPATCH();
+            }
+            OP(STORE_LOCAL) {
+                locals[instruction->a] = std::move(*--sp);
+                DISPATCH();
+            }
+            OP(JUMP_UNLESS_LOCAL_STRING) {
+                if (!locals[instruction->a].is_string()) ip = code + instruction->b;
+                DISPATCH();
+            }
+            OP(APPEND_LOCAL) {
+                sp -= instruction->b;
+                Value& target = locals[instruction->a];
+                target = runtime_.append(std::move(target), sp, instruction->b, instruction->c);
+                for (uint32_t i = 0; i < instruction->b; ++i) sp[i] = Value();
+                DISPATCH();
+            }
+            OP(POP) {
+                *--sp = Value();
+                DISPATCH();
+            }
+
+#define SIA_BINARY_OP(name, token) \
+            OP(name) { \
+                sp[-2] = runtime_.binary_op(token, sp[-2], sp[-1], instruction->c); \
+                *--sp = Value(); \
+                DISPATCH(); \
+            }
+            SIA_BINARY_OP(ADD, TokenType::PLUS)
+            SIA_BINARY_OP(SUBTRACT, TokenType::MINUS)
+            SIA_BINARY_OP(MULTIPLY, TokenType::MULTIPLY)
+            SIA_BINARY_OP(DIVIDE, TokenType::DIVIDE)
+            SIA_BINARY_OP(MODULO, TokenType::MODULO)
+            SIA_BINARY_OP(LESS, TokenType::LESS_THAN)
+            SIA_BINARY_OP(GREATER, TokenType::GREATER_THAN)
+            SIA_BINARY_OP(LESS_EQUAL, TokenType::LESS_EQUAL)
+            SIA_BINARY_OP(GREATER_EQUAL, TokenType::GREATER_EQUAL)
+            SIA_BINARY_OP(EQUAL, TokenType::EQUAL)
+            SIA_BINARY_OP(NOT_EQUAL, TokenType::NOT_EQUAL)
+            SIA_BINARY_OP(BINARY, static_cast<TokenType>(instruction->a))
+#undef SIA_BINARY_OP
+
+            OP(UNARY) {
+                sp[-1] = runtime_.unary_op(static_cast<TokenType>(instruction->a), sp[-1], instruction->c);
+                DISPATCH();
+            }
+            OP(JUMP) {
+                ip = code + instruction->a;
+                DISPATCH();
+            }
+            OP(JUMP_IF_FALSE) {
+                bool condition = runtime_.to_boolean(sp[-1], instruction->c);
+                *--sp = Value();
+                if (!condition) ip = code + instruction->a;
+                DISPATCH();
+            }
+            OP(SHORT_CIRCUIT) {
+                bool condition = runtime_.to_boolean(sp[-1], instruction->c);
+                if (condition == static_cast<bool>(instruction->b)) {
+                    sp[-1] = Value(condition);
+                    ip = code + instruction->a;
+                } else {
+                    *--sp = Value();
+                }
+                DISPATCH();
+            }
+            OP(TRUTH) {
+                sp[-1] = Value(runtime_.to_boolean(sp[-1], instruction->c));
+                DISPATCH();
+            }
+            OP(LOOP_COUNT) {
+                sp[-1] = Value(runtime_.to_long(sp[-1], instruction->c));
+                DISPATCH();
+            }
+            OP(LOOP_NEXT) {
+                long count = sp[-1].as_long();
+                if (count > 0) {
+                    sp[-1] = Value(count - 1);
+                } else {
+                    *--sp = Value();
+                    ip = code + instruction->a;
+                }
+                DISPATCH();
+            }
+            OP(ENTER_SCOPE) {
+                environment_.push(*static_cast<const BlockNode&>(*bytecode_.nodes[instruction->a]).layout);
+                locals = environment_.locals();
+                DISPATCH();
+            }
+            OP(EXIT_SCOPE) {
+                environment_.pop();
+                locals = environment_.locals();
+                DISPATCH();
+            }
+            OP(DEFINE) {
+                auto& definition = static_cast<const FunctionDefNode&>(*bytecode_.nodes[instruction->a]);
+                if (definition.name >= functions_.size()) functions_.resize(runtime_.program().symbols.size());
+                functions_[definition.name] = { &definition, nullptr };
+                DISPATCH();
+            }
+            OP(CALL_NATIVE) {
+                sp -= instruction->b;
+                native_arguments_.clear();
+                for (uint32_t i = 0; i < instruction->b; ++i) native_arguments_.push_back(std::move(sp[i]));
+                *sp++ = (*bytecode_.natives[instruction->a])(native_arguments_, instruction->c);
+                DISPATCH();
+            }
+            OP(PREPARE_CALL) {
+                auto& call = static_cast<const FunctionCallNode&>(*bytecode_.nodes[instruction->a]);
+                if (call.name >= functions_.size() || !functions_[call.name].definition) {
+                    throw runtime_error(runtime_.error_message("Undefined function : " + string(runtime_.program().symbols.name(call.name)), instruction->c));
+                }
+                function_entry& function = functions_[call.name];
+                if (call.arguments.size() != function.definition->parameters.size()) {
+                    throw runtime_error(runtime_.error_message("Argument count mismatch", instruction->c));
+                }
+                if (!function.chunk) function.chunk = &function_chunk(*function.definition);
+
+                calls_++;
+                const Chunk& chunk = *function.chunk;
+                pending_calls_.push_back({ &chunk, environment_.reserve(*chunk.body->layout) });
+                locals = environment_.locals();
+                DISPATCH();
+            }
+            OP(ARGUMENT) {
+                const pending_call& call = pending_calls_.back();
+                environment_.slot(call.base, call.chunk->body->layout->parameters[instruction->a]) = std::move(*--sp);
+                DISPATCH();
+            }
+            OP(TAIL_CALL) {
+                const pending_call call = pending_calls_.back();
+                if (call.chunk != frames_.back().chunk) goto call;
+                // same as Evaluator::tail_call: the arguments reserved for the callee overwrite the
+                // parameters of the running frame, and the body starts over
+                pending_calls_.pop_back();
+                tail_calls_++;
+                frames_.back().tail_calls++;
+                peak_depth_ = max(peak_depth_, ++depth_);
+                locals = environment_.locals();
+                Value* arguments = environment_.slots(call.base);
+                for (uint32_t slot : call.chunk->body->layout->parameters) {
+                    locals[slot] = std::move(arguments[slot]);
+                }
+                environment_.release(call.base);
+                // leaves the counts of the loops the return is in
+                Value* base = stack_.data() + frames_.back().stack_base;
+                while (sp > base) *--sp = Value();
+                ip = code;
+                DISPATCH();
+            }
+            OP(CALL)
+            call: {
+                const pending_call call = pending_calls_.back();
+                pending_calls_.pop_back();
+                peak_depth_ = max(peak_depth_, ++depth_);
+                frames_.push_back({ call.chunk, ip, static_cast<size_t>(sp - stack_.data()), environment_.depth(), 0 });
+                environment_.enter(*call.chunk->body->layout, call.base);
+                sp = ensure_stack(sp, *call.chunk);
+                code = call.chunk->code.data();
+                ip = code;
+                locals = environment_.locals();
+                DISPATCH();
+            }
+            OP(RETURN_NULL) {
+                *sp++ = Value();
+                goto return_value;
+            }
+            OP(RETURN)
+            return_value: {
+                // a return outside of any function ends the program
+                if (frames_.size() == 1) return;
+                Value result = std::move(*--sp);
+                const frame current = frames_.back();
+                frames_.pop_back();
+                depth_ -= 1 + current.tail_calls;
+                environment_.pop_to(current.scope_depth);
+                Value* base = stack_.data() + current.stack_base;
+                while (sp > base) *--sp = Value();
+                *sp++ = std::move(result);
+                code = frames_.back().chunk->code.data();
+                ip = current.return_ip;
+                locals = environment_.locals();
+                DISPATCH();
+            }
+
+#ifndef SIA_COMPUTED_GOTO
+            }
+#endif
+        }
+    } catch (const syntax_error& e) {
+        throw;
+    } catch (const runtime_error& e) {
+        throw block_error(e, instruction);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "bytecode.hpp"
+#include "compiler.hpp"
+#include "environment.hpp"
+#include "runtime.hpp"
+#include "value.hpp"
+
+using namespace std;
+
+// runs programs compiled to bytecode, behaving exactly like the Evaluator.
+// dispatch uses computed goto with GCC and clang, SIA_SWITCH_DISPATCH forces the plain switch
+#if defined(__GNUC__) && !defined(SIA_SWITCH_DISPATCH)
+#define SIA_COMPUTED_GOTO
+#endif
+
+class VM {
+public:
+    VM();
+    void evaluate(const ProgramNode& program);
+    // prints the program's code and that of every function it defines, parsing pre-parsed bodies
+    void disassemble(const ProgramNode& program, ostream& out);
+    void print_stats(ostream& out) const;
+    virtual ~VM() = default;
+
+private:
+    struct function_entry {
+        // null while the function isn't defined
+        const FunctionDefNode* definition = nullptr;
+        const Chunk* chunk = nullptr;
+    };
+
+    struct frame {
+        const Chunk* chunk;
+        // instruction to resume at in the caller
+        const Instruction* return_ip;
+        size_t stack_base;
+        size_t scope_depth;
+        // times the function called itself in a return, reusing the frame
+        size_t tail_calls;
+    };
+
+    // a call whose arguments are being evaluated
+    struct pending_call {
+        const Chunk* chunk;
+        size_t base;
+    };
+
+    Runtime runtime_;
+    Bytecode bytecode_;
+    Compiler compiler_;
+    Chunk program_chunk_;
+    // compiled bodies, by body so a redefinition of the same function reuses its code
+    unordered_map<const BlockNode*, Chunk> chunks_;
+    // indexed by symbol
+    vector<function_entry> functions_;
+
+    Environment environment_;
+    vector<Value> stack_;
+    vector<frame> frames_;
+    vector<pending_call> pending_calls_;
+    vector<Value> native_arguments_;
+    size_t calls_;
+    size_t tail_calls_;
+    // how deep calls got, counting the frames reused by tail calls too
+    size_t depth_, peak_depth_;
+
+    void execute();
+    const Chunk& function_chunk(const FunctionDefNode& definition);
+    Value* ensure_stack(Value* sp, const Chunk& chunk);
+    runtime_error block_error(const runtime_error& error, const Instruction* ip);
+};
@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# runs every tests/*/*.sia in every engine and diffs what it prints, errors included, against the
+# .out file next to it. run from the repository root, SIA=path/to/sia tests/run.sh [script.sia...]
+# ENGINES picks the engines, "build" being an executable made by sia build. a script whose first
+# line is "// options: <flags>" runs once instead, as sia <flags> script.sia
+cd "$(dirname "$0")/.."
+
+SIA=${SIA:-build/sia}
+ENGINES=${ENGINES:-"walker --no-optimize --vm --closures --jit build"}
+
+if [ ! -x "$SIA" ]; then
+    echo "No interpreter at $SIA, build it or set SIA" >&2
+    exit 1
+fi
+
+# the generated code is compiled with the runtime sources of this tree
+export SIA_RUNTIME_DIR=${SIA_RUNTIME_DIR:-$PWD/src}
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+# run <engine> <script>: what the script prints on stdout and stderr. a build that fails prints
+# its syntax error, like running the script would
+run() {
+    case "$1" in
+        walker) "$SIA" "$2" 2>&1 ;;
+        build) if errors=$("$SIA" build "$2" -o "$scratch/program" 2>&1); then "$scratch/program" 2>&1; else echo "$errors"; fi ;;
+        options) "$SIA" $options "$2" 2>&1 ;;
+        *) "$SIA" "$1" "$2" 2>&1 ;;
+    esac
+}
+
+if [ $# -eq 0 ]; then set -- tests/*/*.sia; fi
+passed=0
+failed=0
+for script in "$@"; do
+    expected="${script%.sia}.out"
+    options=$(sed -n '1s|^// options: ||p' "$script")
+    engines=${options:+options}
+    for engine in ${engines:-$ENGINES}; do
+        if run "$engine" "$script" | diff -u "$expected" - > "$scratch/diff"; then
+            passed=$((passed + 1))
+        else
+            failed=$((failed + 1))
+            echo "FAIL $script (${options:-$engine})"
+            cat "$scratch/diff"
+        fi
+    done
+done
+echo "$passed passed, $failed failed"
+[ "$failed" -eq 0 ]